@@ -0,0 +1,115 @@
+#!/bin/sh
+# Compare the bulk array natives against the equivalent Raven loops, over
+# an array of numbers. The natives run 50 times more rounds than the
+# loops, each time is the best of 3 runs, less the time of building the
+# array, and is reported per round.
+#
+# Usage: benchmarks/bulk.sh [raven binary] [array length] [rounds]
+
+RAVEN=${1:-./build/release/raven}
+LENGTH=${2:-1000000}
+ROUNDS=${3:-20}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# script NAME ROUNDS BODY, where BODY runs once per round with `xs` and `ys`
+script() {
+    cat > "$DIR/$1.rav" <<EOF
+let xs = []
+let ys = []
+let i = 0
+while i < $LENGTH do
+  push(xs, (i * 7) % 1000 / 10)
+  push(ys, (i * 3) % 100)
+  i = i + 1
+end
+let n = len(xs)
+let result = nil
+let round = 0
+while round < $2 do
+$3
+  round = round + 1
+end
+println(result)
+EOF
+}
+
+# elapsed NAME, the best time of 3 runs in microseconds
+elapsed() {
+    best=
+    for run in 1 2 3; do
+        start=$(date +%s%N)
+        "$RAVEN" "$DIR/$1.rav" > /dev/null
+        end=$(date +%s%N)
+        time=$(((end - start) / 1000))
+        if [ -z "$best" ] || [ "$time" -lt "$best" ]; then best=$time; fi
+    done
+    echo "$best"
+}
+
+NATIVE_ROUNDS=$((ROUNDS * 50))
+
+script setup 0 ""
+
+script sum_native $NATIVE_ROUNDS "  result = sum(xs)"
+script sum_loop $ROUNDS "  let total = 0
+  let j = 0
+  while j < n do total = total + xs[j] j = j + 1 end
+  result = total"
+
+script min_native $NATIVE_ROUNDS "  result = min(xs)"
+script min_loop $ROUNDS "  let least = xs[0]
+  let j = 1
+  while j < n do
+    if xs[j] < least do least = xs[j] end
+    j = j + 1
+  end
+  result = least"
+
+script max_native $NATIVE_ROUNDS "  result = max(xs)"
+script max_loop $ROUNDS "  let most = xs[0]
+  let j = 1
+  while j < n do
+    if xs[j] > most do most = xs[j] end
+    j = j + 1
+  end
+  result = most"
+
+script dot_native $NATIVE_ROUNDS "  result = dot(xs, ys)"
+script dot_loop $ROUNDS "  let total = 0
+  let j = 0
+  while j < n do total = total + xs[j] * ys[j] j = j + 1 end
+  result = total"
+
+script scale_native $NATIVE_ROUNDS "  result = scale(xs, 2)"
+script scale_loop $ROUNDS "  let scaled = []
+  let j = 0
+  while j < n do push(scaled, xs[j] * 2) j = j + 1 end
+  result = len(scaled)"
+
+script fill_native $NATIVE_ROUNDS "  result = len(fill(ys, round))"
+script fill_loop $ROUNDS "  let j = 0
+  while j < n do ys[j] = round j = j + 1 end
+  result = len(ys)"
+
+script copy_native $NATIVE_ROUNDS "  result = len(copy(xs))"
+script copy_loop $ROUNDS "  let copied = []
+  let j = 0
+  while j < n do push(copied, xs[j]) j = j + 1 end
+  result = len(copied)"
+
+script slice_native $NATIVE_ROUNDS "  result = len(slice(xs, n / 4, n / 2))"
+script slice_loop $ROUNDS "  let sliced = []
+  let j = n / 4
+  while j < n / 2 do push(sliced, xs[j]) j = j + 1 end
+  result = len(sliced)"
+
+SETUP=$(elapsed setup)
+echo "array: $LENGTH numbers, setup: $((SETUP / 1000)) ms"
+
+for name in sum min max dot scale fill copy slice; do
+    native=$((($(elapsed ${name}_native) - SETUP) / NATIVE_ROUNDS))
+    loop=$((($(elapsed ${name}_loop) - SETUP) / ROUNDS))
+    echo "$name: native $native us, loop $loop us, $((loop / (native + 1)))x"
+done
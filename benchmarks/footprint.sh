@@ -0,0 +1,77 @@
+#!/bin/sh
+# Measure the peak memory of pair and string heavy mixes: lists consed one
+# pair at a time, lists built at once by `map`, strings built by
+# interpolation, and slices of split lines, all kept alive until the end.
+# Given a second binary (e.g. one built from an earlier revision), its
+# peaks are reported beside. Each peak is the resident set high-water mark,
+# read by the script itself from /proc/self/status once it's done.
+#
+# Usage: benchmarks/footprint.sh [raven binary] [baseline binary] [count]
+
+RAVEN=${1:-./build/release/raven}
+BASELINE=$2
+COUNT=${3:-200000}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# script NAME BODY, where BODY keeps what it builds in `kept`
+script() {
+    cat > "$DIR/$1.rav" <<EOF
+let n = $COUNT
+let kept = []
+$2
+let status = open("/proc/self/status")
+let line = read_line(status)
+while line != nil do
+  if slice(line, 0, 6) == "VmHWM:" do println(line) end
+  line = read_line(status)
+end
+close(status)
+EOF
+}
+
+# peak BINARY NAME, the peak resident set in KB
+peak() {
+    "$1" "$DIR/$2.rav" | awk '/^VmHWM:/ { print $2 }'
+}
+
+script empty ""
+
+script cons "let round = 0
+while round < 10 do
+  let list = nil
+  let i = 0
+  while i < n do list = i :: list i = i + 1 end
+  push(kept, list)
+  round = round + 1
+end"
+
+script list "let source = nil
+let i = 0
+while i < n do source = i :: source i = i + 1 end
+let round = 0
+while round < 10 do
+  push(kept, map(source, \\x -> x + round))
+  round = round + 1
+end"
+
+script strings "let i = 0
+while i < n * 5 do
+  push(kept, \"item {{i}}\")
+  i = i + 1
+end"
+
+script slices "let i = 0
+while i < n do
+  push(kept, split(\"alpha,beta,gamma,delta,{{i}}\", \",\"))
+  i = i + 1
+end"
+
+for name in empty cons list strings slices; do
+    if [ -n "$BASELINE" ]; then
+        echo "$name: $(peak "$RAVEN" $name) KB, baseline $(peak "$BASELINE" $name) KB"
+    else
+        echo "$name: $(peak "$RAVEN" $name) KB"
+    fi
+done
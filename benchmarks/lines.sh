@@ -0,0 +1,50 @@
+#!/bin/sh
+# Measure the lines per second of `read_line` over a large file, read from
+# a mapped regular file and streamed from a pipe, against `wc -l`.
+#
+# Usage: benchmarks/lines.sh [raven binary] [file size in MB]
+
+RAVEN=${1:-./build/release/raven}
+SIZE=${2:-2048}
+
+DIR=$(mktemp -d)
+INPUT=$DIR/lines.txt
+SCRIPT=$DIR/lines.rav
+trap 'rm -rf "$DIR"' EXIT
+
+yes "the quick brown fox jumps over the lazy dog, 0123456789" | head -c "${SIZE}M" > "$INPUT"
+
+cat > "$SCRIPT" <<EOF
+let file = open(argument)
+let lines = 0
+let bytes = 0
+let line = read_line(file)
+while line != nil do
+  lines = lines + 1
+  bytes = bytes + len(line) + 1
+  line = read_line(file)
+end
+close(file)
+println(lines, bytes)
+EOF
+
+elapsed() {
+    start=$(date +%s%N)
+    "$@" > /dev/null
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000000))
+}
+
+LINES=$(wc -l < "$INPUT")
+
+report() {
+    echo "$1: $2 ms, $((LINES * 1000 / ($2 + 1))) lines/s"
+}
+
+sed 's|argument|"'"$INPUT"'"|' "$SCRIPT" > "$DIR/mapped.rav"
+sed 's|argument|"/dev/stdin"|' "$SCRIPT" > "$DIR/streamed.rav"
+
+echo "file: $SIZE MB, $LINES lines"
+report "wc -l   " "$(elapsed wc -l "$INPUT")"
+report "mapped  " "$(elapsed "$RAVEN" "$DIR/mapped.rav")"
+report "streamed" "$(elapsed sh -c "cat '$INPUT' | '$RAVEN' '$DIR/streamed.rav'")"
@@ -0,0 +1,78 @@
+// Compare the number conversions (src/number.c) against the C library.
+//
+// Build: gcc -std=gnu99 -O2 -Isrc benchmarks/numbers.c src/number.c -o numbers -lm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "number.h"
+
+#define COUNT 1000000
+
+static double elapsed(struct timespec start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+int main(void) {
+    double *numbers = malloc(COUNT * sizeof (double));
+    char (*texts)[NUMBER_BUFFER_SIZE] = malloc(COUNT * NUMBER_BUFFER_SIZE);
+
+    // A mix of integers, short decimals and random doubles.
+    srand(42);
+    for (int i = 0; i < COUNT; i++) {
+        switch (i % 3) {
+        case 0: numbers[i] = rand() % 100000; break;
+        case 1: numbers[i] = (rand() % 100000) / 100.0; break;
+        case 2: numbers[i] = (double)rand() / rand() * 1e-3; break;
+        }
+    }
+
+    struct timespec start;
+    char buffer[64];
+    size_t checksum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < COUNT; i++) {
+        checksum += snprintf(buffer, sizeof buffer, "%g", numbers[i]);
+    }
+    printf("format  snprintf %%g:    %7.1f ms (not round-trip)\n", elapsed(start));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < COUNT; i++) {
+        checksum += snprintf(buffer, sizeof buffer, "%.17g", numbers[i]);
+    }
+    printf("format  snprintf %%.17g: %7.1f ms (not shortest)\n", elapsed(start));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < COUNT; i++) {
+        checksum += number_format(numbers[i], texts[i]);
+    }
+    printf("format  number_format:  %7.1f ms\n", elapsed(start));
+
+    double sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < COUNT; i++) {
+        sum += strtod(texts[i], NULL);
+    }
+    printf("parse   strtod:         %7.1f ms\n", elapsed(start));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < COUNT; i++) {
+        double number;
+        number_parse(texts[i], strlen(texts[i]), &number);
+        sum -= number;
+    }
+    printf("parse   number_parse:   %7.1f ms\n", elapsed(start));
+
+    // Keep the results alive.
+    printf("(checksum %zu %g)\n", checksum, sum);
+
+    free(numbers);
+    free(texts);
+    return 0;
+}
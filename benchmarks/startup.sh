@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compare the startup time of a large script compiled from source (cold)
+# against loading it from its '.ravc' bytecode cache.
+#
+# Usage: benchmarks/startup.sh [raven binary] [functions count]
+
+RAVEN=${1:-./build/release/raven}
+COUNT=${2:-20000}
+RUNS=10
+
+DIR=$(mktemp -d)
+SCRIPT=$DIR/startup.rav
+trap 'rm -rf "$DIR"' EXIT
+
+i=0
+while [ $i -lt "$COUNT" ]; do
+    echo "fn f$i(x, y) if x < y do \"lt $i\" else [x, y, $i.5, \"ge $i\"] end end"
+    i=$((i + 1))
+done > "$SCRIPT"
+echo "f1(1, 2)" >> "$SCRIPT"
+
+elapsed() {
+    start=$(date +%s%N)
+    "$@" > /dev/null
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000))
+}
+
+cold=0
+cached=0
+for run in $(seq $RUNS); do
+    rm -f "$DIR/startup.ravc"
+    cold=$((cold + $(elapsed "$RAVEN" "$SCRIPT")))
+    cached=$((cached + $(elapsed "$RAVEN" "$SCRIPT")))
+done
+
+echo "functions: $COUNT, source: $(wc -c < "$SCRIPT") bytes, cache: $(wc -c < "$DIR/startup.ravc") bytes"
+echo "cold:   $((cold / RUNS)) us"
+echo "cached: $((cached / RUNS)) us"
@@ -0,0 +1,133 @@
+#!/bin/sh
+# Measure hash table heavy mixes: map lookups, inserts into fresh maps,
+# inserts and removes over a sliding window of keys, interning of new
+# strings, and globals access. Given a second binary (e.g. one built from
+# an earlier revision), its times are reported beside. Each time is the
+# best of 3 runs, less the time of building the keys.
+#
+# Usage: benchmarks/tables.sh [raven binary] [baseline binary] [keys count]
+
+RAVEN=${1:-./build/release/raven}
+BASELINE=$2
+COUNT=${3:-100000}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# script NAME BODY, where BODY runs with `keys`, an array of COUNT strings,
+# and `numbers`, an array of COUNT numbers
+script() {
+    cat > "$DIR/$1.rav" <<EOF
+let keys = []
+let numbers = []
+let i = 0
+while i < $COUNT do
+  push(keys, "key {{i}}")
+  push(numbers, i * 7.5)
+  i = i + 1
+end
+let n = $COUNT
+let result = nil
+$2
+println(result)
+EOF
+}
+
+# elapsed BINARY NAME, the best time of 3 runs in milliseconds
+elapsed() {
+    best=
+    for run in 1 2 3; do
+        start=$(date +%s%N)
+        "$1" "$DIR/$2.rav" > /dev/null
+        end=$(date +%s%N)
+        time=$(((end - start) / 1000000))
+        if [ -z "$best" ] || [ "$time" -lt "$best" ]; then best=$time; fi
+    done
+    echo "$best"
+}
+
+script setup ""
+
+script lookup "let m = {}
+for k in keys do m[k] = 1 end
+let total = 0
+let round = 0
+while round < 20 do
+  for k in keys do total = total + m[k] end
+  round = round + 1
+end
+result = total"
+
+script lookup_numbers "let m = {}
+for x in numbers do m[x] = 1 end
+let total = 0
+let round = 0
+while round < 20 do
+  for x in numbers do total = total + m[x] end
+  round = round + 1
+end
+result = total"
+
+script miss "let m = {}
+let j = 0
+while j < n / 2 do m[keys[j]] = 1 j = j + 1 end
+let found = 0
+let round = 0
+while round < 20 do
+  j = n / 2
+  while j < n do
+    if m[keys[j]] != nil do found = found + 1 end
+    j = j + 1
+  end
+  round = round + 1
+end
+result = found"
+
+script insert "let round = 0
+while round < 10 do
+  let m = {}
+  for k in keys do m[k] = round end
+  result = len(m)
+  round = round + 1
+end"
+
+script delete "let m = {}
+let j = 0
+while j < n * 10 do
+  m[keys[j % n]] = j
+  if j >= 1000 do remove(m, keys[(j - 1000) % n]) end
+  j = j + 1
+end
+result = len(m)"
+
+script intern "let j = 0
+let last = nil
+while j < n * 5 do
+  last = \"fresh {{j}}\"
+  j = j + 1
+end
+result = last"
+
+script globals "let a = 1
+let b = 2
+let total = 0
+let j = 0
+while j < n * 20 do
+  total = total + a + b
+  j = j + 1
+end
+result = total"
+
+SETUP=$(elapsed "$RAVEN" setup)
+if [ -n "$BASELINE" ]; then BASELINE_SETUP=$(elapsed "$BASELINE" setup); fi
+echo "keys: $COUNT, setup: $SETUP ms"
+
+for name in lookup lookup_numbers miss insert delete intern globals; do
+    time=$(($(elapsed "$RAVEN" $name) - SETUP))
+    if [ -n "$BASELINE" ]; then
+        baseline=$(($(elapsed "$BASELINE" $name) - BASELINE_SETUP))
+        echo "$name: $time ms, baseline $baseline ms"
+    else
+        echo "$name: $time ms"
+    fi
+done
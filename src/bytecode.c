@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bytecode.h"
+#include "chunk.h"
+#include "common.h"
+#include "mem.h"
+#include "object.h"
+#include "value.h"
+#include "vm.h"
+
+// Must be bumped on every change of the cache file layout, or of the
+// instructions encoding.
+#define BYTECODE_VERSION 8
+
+typedef struct {
+    char magic[4];               // "RAVC"
+    uint32_t version;            // BYTECODE_VERSION
+    uint32_t opcodes_count;      // Guard against instructions renumbering
+    uint32_t padding;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t checksum;           // Of the image after the header
+} Header;
+
+// The cache file is an image mapped read-only into memory, and executed
+// in place, function opcodes, lines and strings characters are referenced
+// by the loaded objects directly, only the constants array (which holds
+// pointers) is built at loading.
+//
+//   function := name:string? arity:i32 upvalue_count:i32 max_slots:i32
+//               count:i32 opcodes:u8[count] <align> lines_count:i32
+//               lines:Line[lines_count] constants_count:i32 constant*
+//   constant := tag:u8 (number:f64 | string | function)
+//   string   := length:i32 hash:u32 chars:u8[length] '\0'
+//
+// The function name length is -1 for anonymous functions.
+
+typedef enum {
+    CONSTANT_NUMBER,
+    CONSTANT_STRING,
+    CONSTANT_FUNCTION,
+} ConstantTag;
+
+// Return the cache path of a source file, 'script.rav' is cached in
+// 'script.ravc', and other files get the '.ravc' extension appended.
+static char *cache_path(const char *path) {
+    size_t length = strlen(path);
+    char *cache = malloc(length + sizeof ".ravc");
+
+    memcpy(cache, path, length);
+    if (length >= 4 && strcmp(path + length - 4, ".rav") == 0) {
+        strcpy(cache + length, "c");
+    } else {
+        strcpy(cache + length, ".ravc");
+    }
+
+    return cache;
+}
+
+// FNV-1a hash of the image body, a damaged (or partially overwritten)
+// cache is rejected before any of it is loaded.
+static uint64_t checksum(const uint8_t *bytes, size_t count) {
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < count; i++) {
+        hash ^= bytes[i];
+        hash *= UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+static Header make_header(struct stat *source) {
+    Header header = {0};
+    memcpy(header.magic, "RAVC", 4);
+    header.version = BYTECODE_VERSION;
+    header.opcodes_count = OPCODES_COUNT;
+    header.source_size = (uint64_t)source->st_size;
+    header.source_mtime_sec = (int64_t)source->st_mtim.tv_sec;
+    header.source_mtime_nsec = (int64_t)source->st_mtim.tv_nsec;
+    return header;
+}
+
+/// Writing
+
+typedef struct {
+    uint8_t *bytes;
+    size_t count;
+    size_t capacity;
+} Writer;
+
+static void write_bytes(Writer *writer, const void *bytes, size_t size) {
+    if (writer->count + size > writer->capacity) {
+        size_t capacity = Grow_Capacity(writer->capacity);
+        while (capacity < writer->count + size) {
+            capacity *= 2;
+        }
+
+        writer->bytes = realloc(writer->bytes, capacity);
+        writer->capacity = capacity;
+    }
+
+    memcpy(writer->bytes + writer->count, bytes, size);
+    writer->count += size;
+}
+
+static inline void write_u8(Writer *writer, uint8_t byte) {
+    write_bytes(writer, &byte, sizeof byte);
+}
+
+static inline void write_i32(Writer *writer, int32_t number) {
+    write_bytes(writer, &number, sizeof number);
+}
+
+static void write_align(Writer *writer, size_t alignment) {
+    while (writer->count % alignment != 0) {
+        write_u8(writer, 0);
+    }
+}
+
+static void write_string(Writer *writer, RavString *string) {
+    write_i32(writer, string->length);
+    write_bytes(writer, &string->hash, sizeof string->hash);
+    write_bytes(writer, string->chars, string->length + 1);
+}
+
+static void write_function(Writer *writer, RavFunction *function) {
+    if (function->name == NULL) {
+        write_i32(writer, -1);
+    } else {
+        write_string(writer, function->name);
+    }
+
+    write_i32(writer, function->arity);
+    write_i32(writer, function->upvalue_count);
+    write_i32(writer, function->max_slots);
+
+    Chunk *chunk = &function->chunk;
+
+    write_i32(writer, chunk->count);
+    write_bytes(writer, chunk->opcodes, chunk->count);
+    write_align(writer, _Alignof (Line));
+
+    write_i32(writer, chunk->lines_count);
+    write_bytes(writer, chunk->lines, chunk->lines_count * sizeof (Line));
+
+    write_i32(writer, chunk->constants_count);
+    for (int i = 0; i < chunk->constants_count; i++) {
+        Value constant = chunk->constants[i];
+
+        if (Is_Num(constant)) {
+            double number = As_Num(constant);
+            write_u8(writer, CONSTANT_NUMBER);
+            write_bytes(writer, &number, sizeof number);
+        } else if (Is_String(constant)) {
+            write_u8(writer, CONSTANT_STRING);
+            write_string(writer, As_String(constant));
+        } else if (Is_Function(constant)) {
+            write_u8(writer, CONSTANT_FUNCTION);
+            write_function(writer, As_Function(constant));
+        } else {
+            assert(!"unreachable: invalid constant type");
+        }
+    }
+}
+
+bool bytecode_save(RavFunction *function, const char *path) {
+    struct stat source;
+    if (stat(path, &source) != 0) {
+        return false;
+    }
+
+    Writer writer = {0};
+    Header header = make_header(&source);
+    write_bytes(&writer, &header, sizeof header);
+    write_function(&writer, function);
+
+    uint64_t sum = checksum(writer.bytes + sizeof header, writer.count - sizeof header);
+    memcpy(writer.bytes + offsetof(Header, checksum), &sum, sizeof sum);
+
+    // Write to a temporary file first, then rename it to the cache path,
+    // so concurrent processes never see a partially written cache.
+    char *cache = cache_path(path);
+    char *temporary = malloc(strlen(cache) + 32);
+    sprintf(temporary, "%s.%ld", cache, (long)getpid());
+
+    bool written = false;
+    FILE *file = fopen(temporary, "wb");
+    if (file != NULL) {
+        written = fwrite(writer.bytes, 1, writer.count, file) == writer.count;
+        written = fclose(file) == 0 && written;
+        written = written && rename(temporary, cache) == 0;
+
+        if (!written) {
+            remove(temporary);
+        }
+    }
+
+    free(temporary);
+    free(cache);
+    free(writer.bytes);
+    return written;
+}
+
+/// Loading
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t count;
+    size_t offset;
+    bool failed;
+} Reader;
+
+// Return a pointer to the next `size` bytes, or NULL if they are out of
+// the buffer bounds.
+static const void *read_span(Reader *reader, int32_t size) {
+    if (reader->failed || size < 0 || reader->count - reader->offset < (size_t)size) {
+        reader->failed = true;
+        return NULL;
+    }
+
+    const void *span = reader->bytes + reader->offset;
+    reader->offset += size;
+    return span;
+}
+
+static uint8_t read_u8(Reader *reader) {
+    const uint8_t *span = read_span(reader, sizeof (uint8_t));
+    return span ? *span : 0;
+}
+
+static int32_t read_i32(Reader *reader) {
+    int32_t number = 0;
+    const void *span = read_span(reader, sizeof number);
+    if (span) memcpy(&number, span, sizeof number);
+    return number;
+}
+
+static bool read_align(Reader *reader, size_t alignment) {
+    size_t padding = (alignment - reader->offset % alignment) % alignment;
+    return read_span(reader, padding) != NULL;
+}
+
+// Read a string referencing its characters in the image.
+static RavString *read_string(Allocator *allocator, Reader *reader, int32_t length) {
+    uint32_t hash = 0;
+    const void *span = read_span(reader, sizeof hash);
+    if (span) memcpy(&hash, span, sizeof hash);
+
+    const char *chars = length < INT32_MAX ? read_span(reader, length + 1) : NULL;
+    if (chars == NULL || chars[length] != '\0') {
+        reader->failed = true;
+        return NULL;
+    }
+
+    return object_string_borrow(allocator, chars, length, hash);
+}
+
+static RavFunction *read_function(VM *vm, Reader *reader) {
+    Allocator *allocator = &vm->allocator;
+    RavFunction *function = object_function(allocator);
+
+    int32_t name_length = read_i32(reader);
+    if (name_length != -1) {
+        function->name = read_string(allocator, reader, name_length);
+        if (function->name == NULL) return NULL;
+    }
+
+    function->arity = read_i32(reader);
+    function->upvalue_count = read_i32(reader);
+    function->max_slots = read_i32(reader);
+
+    Chunk *chunk = &function->chunk;
+
+    int32_t count = read_i32(reader);
+    const uint8_t *opcodes = read_span(reader, count);
+    if (opcodes == NULL || !read_align(reader, _Alignof (Line))) return NULL;
+
+    int32_t lines_count = read_i32(reader);
+    if (lines_count < 0 || lines_count > INT32_MAX / (int32_t)sizeof (Line)) return NULL;
+
+    const Line *lines = read_span(reader, lines_count * sizeof (Line));
+    if (lines == NULL) return NULL;
+
+    chunk->borrowed = true;
+    allocator_retain(allocator, opcodes);
+    chunk->opcodes = (uint8_t *)opcodes;
+    chunk->count = chunk->capacity = count;
+    chunk->lines = (Line *)lines;
+    chunk->lines_count = chunk->lines_capacity = lines_count;
+
+    int32_t constants_count = read_i32(reader);
+    if (constants_count < 0 || constants_count > CONST_LIMIT) return NULL;
+
+    for (int i = 0; i < constants_count; i++) {
+        switch (read_u8(reader)) {
+        case CONSTANT_NUMBER: {
+            double number;
+            const void *span = read_span(reader, sizeof number);
+            if (span == NULL) return NULL;
+
+            memcpy(&number, span, sizeof number);
+            chunk_write_constant(chunk, Num_Value(number));
+            break;
+        }
+
+        case CONSTANT_STRING: {
+            RavString *string = read_string(allocator, reader, read_i32(reader));
+            if (string == NULL) return NULL;
+
+            chunk_write_constant(chunk, Obj_Value(string));
+            break;
+        }
+
+        case CONSTANT_FUNCTION: {
+            RavFunction *nested = read_function(vm, reader);
+            if (nested == NULL) return NULL;
+
+            chunk_write_constant(chunk, Obj_Value(nested));
+            break;
+        }
+
+        default:
+            return NULL;
+        }
+    }
+
+    return reader->failed ? NULL : function;
+}
+
+RavFunction *bytecode_load(VM *vm, const char *path) {
+    struct stat source;
+    if (stat(path, &source) != 0) {
+        return NULL;
+    }
+
+    char *cache = cache_path(path);
+    size_t size = 0;
+    const uint8_t *image = allocator_map(&vm->allocator, cache, &size);
+    free(cache);
+
+    if (image == NULL) {
+        return NULL;
+    }
+
+    // The header is compared up to the checksum, which is verified after.
+    Header expected = make_header(&source);
+    if (size < sizeof (Header) || memcmp(image, &expected, offsetof(Header, checksum)) != 0) {
+        allocator_release(&vm->allocator, image);
+        return NULL;
+    }
+
+    uint64_t sum;
+    memcpy(&sum, image + offsetof(Header, checksum), sizeof sum);
+    if (sum != checksum(image + sizeof (Header), size - sizeof (Header))) {
+        allocator_release(&vm->allocator, image);
+        return NULL;
+    }
+
+    Reader reader = { image, size, sizeof (Header), false };
+    RavFunction *function = read_function(vm, &reader);
+
+    // Trailing garbage indicates a malformed cache.
+    if (reader.offset != reader.count) {
+        function = NULL;
+    }
+
+    // The loaded objects keep the image mapped, including the partially
+    // loaded ones on failure (and interned strings), until they are freed.
+    allocator_release(&vm->allocator, image);
+    return function;
+}
@@ -0,0 +1,24 @@
+#ifndef raven_bytecode_h
+#define raven_bytecode_h
+
+// Compiled Bytecode Cache Files
+//
+// A compiled source file 'script.rav' is cached in 'script.ravc', the
+// cache stores the top-level function with all of its nested functions
+// (opcodes, lines and constants), along with the size and modification
+// time of the source file it was compiled from. Caches are mapped into
+// memory and executed in place.
+
+#include "common.h"
+#include "vm.h"
+
+// Load the bytecode cache of the source file at the given path. Return
+// NULL if there is no cache, or it's stale or malformed. The GC must be
+// disabled while loading, since the loaded objects are not rooted yet.
+RavFunction *bytecode_load(VM *vm, const char *path);
+
+// Write the bytecode cache of the compiled source file at the given path.
+// Return true if the cache file is written.
+bool bytecode_save(RavFunction *function, const char *path);
+
+#endif
@@ -15,11 +15,18 @@ void chunk_init(Chunk *chunk) {
     chunk->lines = NULL;
 
     chunk->constants_count = 0;
+    chunk->constants_capacity = 0;
+    chunk->constants = NULL;
+
+    chunk->borrowed = false;
 }
 
 void chunk_free(Chunk *chunk) {
-    free(chunk->opcodes);
-    free(chunk->lines);
+    if (!chunk->borrowed) {
+        free(chunk->opcodes);
+        free(chunk->lines);
+    }
+    free(chunk->constants);
 
     chunk_init(chunk);
 }
@@ -51,6 +58,11 @@ void chunk_write_byte(Chunk *chunk, uint8_t byte, int line) {
 }
 
 int chunk_write_constant(Chunk *chunk, Value value) {
+    if (chunk->constants_count == chunk->constants_capacity) {
+        chunk->constants_capacity = Grow_Capacity(chunk->constants_capacity);
+        chunk->constants = realloc(chunk->constants, chunk->constants_capacity * sizeof (Value));
+    }
+
     chunk->constants[chunk->constants_count++] = value;
     return chunk->constants_count - 1;
 }
@@ -8,6 +8,7 @@ enum {
 #define Opcode(opcode) opcode,
 # include "opcode.h"
 #undef Opcode
+    OPCODES_COUNT
 };
 
 // Line encoding
@@ -29,9 +30,13 @@ typedef struct {
     int lines_capacity;
     Line *lines;
 
-    // +1 to not cause an overflow, for the overwritten value.
-    Value constants[CONST_LIMIT + 1];
+    // Dynamic array of the constants referenced by the opcodes.
     int constants_count;
+    int constants_capacity;
+    Value *constants;
+
+    // The opcodes and lines memory is not owned (e.g. a mapped image).
+    bool borrowed;
 } Chunk;
 
 // Initialize the chunk state.
@@ -38,23 +38,27 @@
 // Maximum number of values on the stack.
 #define STACK_SIZE (256 * FRAMES_LIMIT)
 
-// The limit of number of locals per function.
-#define LOCALS_LIMIT UINT8_MAX + 1
+// Size of the buffered output, before it gets flushed.
+#define OUTPUT_BUFFER_SIZE 65536
+
+// The limit of number of locals per function, the locals of a called
+// function must fit in the stack, besides the caller.
+#define LOCALS_LIMIT (STACK_SIZE - 1)
 
 // The limit of number of variables a closure can capture.
-#define UPVALUES_LIMIT UINT8_MAX + 1
+#define UPVALUES_LIMIT (UINT16_MAX + 1)
 
 // The limit of number of constants per function.
-#define CONST_LIMIT UINT8_MAX + 1
+#define CONST_LIMIT (UINT16_MAX + 1)
 
 // The limie of number of parameters a function can have.
-#define PARAMS_LIMIT UINT8_MAX + 1
+#define PARAMS_LIMIT (UINT8_MAX + 1)
 
 // The limit of number of elements in an array literal.
-#define ARRAY_LIMIT UINT16_MAX + 1
+#define ARRAY_LIMIT (UINT16_MAX + 1)
 
 // The limit of number of elements in a map literal.
-#define MAP_LIMIT UINT16_MAX + 1
+#define MAP_LIMIT (UINT16_MAX + 1)
 
 // The limit of cond cases.
 #define COND_LIMIT 256
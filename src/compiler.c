@@ -6,6 +6,7 @@
 #include "common.h"
 #include "compiler.h"
 #include "lexer.h"
+#include "number.h"
 #include "object.h"
 #include "value.h"
 #include "vm.h"
@@ -37,9 +38,15 @@ typedef struct {
     // captured variable in the surround function frame, otherwise
     // it stores the index of the captured variable in the surrounding
     // function upvalues list.
-    uint8_t index;
+    uint16_t index;
 } Upvalue;
 
+// Constants lookup entry, maps a constant to its index in the chunk.
+typedef struct {
+    Value key;
+    int index;         // -1 indicates an empty entry
+} ConstantEntry;
+
 // Function Lexical Block State
 typedef struct Context {
     struct Context *enclosing;
@@ -47,14 +54,35 @@ typedef struct Context {
     RavFunction *function; // Current output chunk, bytecode stream
     bool toplevel;
 
-    Local locals[LOCALS_LIMIT];
+    Local *locals;
     int local_count;       // Number of locals in the current scope
+    int local_capacity;
 
-    Upvalue upvalues[UPVALUES_LIMIT];
+    Upvalue *upvalues;
+    int upvalue_capacity;
 
     int scope_depth;       // Number of the surrounding blocks
+    int getter_offset;     // Offset of the last variable getter, or -1
+
+    // Linear probing hash table of the numbers and strings constants,
+    // used to deduplicate the constants of the chunk.
+    ConstantEntry *constants;
+    int constants_count;
+    int constants_mask;
 } Context;
 
+// Innermost Loop State, used by the continue and break statements
+typedef struct Loop {
+    struct Loop *enclosing;
+
+    int start;             // Offset of the next iteration
+    int depth;             // Scope depth of the loop body
+
+    int *breaks;           // Offsets of the break jumps to the loop exit
+    int breaks_count;
+    int breaks_capacity;
+} Loop;
+
 // Parser State
 typedef struct {
     Lexer *lexer;     // The input, token stream
@@ -67,9 +95,7 @@ typedef struct {
     bool had_error;   // Error flag to stop bytecode execution later
     bool panic_mode;  // If set, any parsing error will be ignored
 
-    // Used in continue statement
-    int inner_loop_start;
-    int inner_loop_depth;
+    Loop *loop;       // The innermost loop of the current function, or NULL
 
 #ifdef DEBUG_TRACE_PARSING
     int level;        // Parser nesting level, for debugging
@@ -213,6 +239,37 @@ static inline void emit_bytes(Parser *parser, uint8_t x, uint8_t y) {
     emit_byte(parser, y);
 }
 
+// Return the 2-bytes operand variant of a 1-byte operand instruction.
+static inline uint8_t wide_opcode(uint8_t instruction) {
+    switch (instruction) {
+    case OP_PUSH_CONST:       return OP_PUSH_CONST_16;
+    case OP_POPN:             return OP_POPN_16;
+    case OP_DEF_GLOBAL:       return OP_DEF_GLOBAL_16;
+    case OP_SET_GLOBAL:       return OP_SET_GLOBAL_16;
+    case OP_GET_GLOBAL:       return OP_GET_GLOBAL_16;
+    case OP_SET_LOCAL:        return OP_SET_LOCAL_16;
+    case OP_GET_LOCAL:        return OP_GET_LOCAL_16;
+    case OP_SET_UPVALUE:      return OP_SET_UPVALUE_16;
+    case OP_GET_UPVALUE:      return OP_GET_UPVALUE_16;
+    case OP_CLOSURE:          return OP_CLOSURE_16;
+    case OP_MAP_PUSH_ELEMENT: return OP_MAP_PUSH_ELEMENT_16;
+    default:
+        assert(!"instruction has no wide variant");
+        return instruction;
+    }
+}
+
+// Emit an instruction with an index operand, the wide variant of the
+// instruction is used if the index doesn't fit in one byte.
+static inline void emit_indexed(Parser *parser, uint8_t instruction, int index) {
+    if (index > UINT8_MAX) {
+        emit_byte(parser, wide_opcode(instruction));
+        emit_bytes(parser, (index >> 8) & 0xff, index & 0xff);
+    } else {
+        emit_bytes(parser, instruction, (uint8_t)index);
+    }
+}
+
 static inline int emit_jump(Parser *parser, uint8_t instruction) {
     emit_byte(parser, instruction);
     emit_bytes(parser, 0xff, 0xff);
@@ -245,26 +302,108 @@ static inline void patch_jump(Parser *parser, int from) {
     chunk->opcodes[from + 1] = offset & 0xff;
 }
 
-static inline uint8_t make_constant(Parser *parser, Value value) {
-    int constant_index = chunk_write_constant(parser_chunk(parser), value);
+// Bits identifying a number or string constant. Numbers are identified
+// by their bit pattern rather than by `==`, so 0.0 and -0.0 stay distinct
+// constants, and a NaN can still be found.
+static inline uint64_t constant_bits(Value value) {
+#ifdef NAN_TAGGING
+    return value;
+#else
+    if (Is_Obj(value)) {
+        return (uint64_t)(uintptr_t)As_Obj(value);
+    }
+
+    uint64_t bits;
+    double number = As_Num(value);
+    memcpy(&bits, &number, sizeof (uint64_t));
+    return bits;
+#endif
+}
 
-    if (constant_index >= CONST_LIMIT) {
+static inline bool constant_identical(Value x, Value y) {
+    return Is_Num(x) == Is_Num(y) && constant_bits(x) == constant_bits(y);
+}
+
+static ConstantEntry *find_constant(ConstantEntry *entries, int mask, Value key) {
+    uint64_t bits = constant_bits(key);
+    uint32_t index = (uint32_t)((bits * 0x9e3779b97f4a7c15u) >> 32) & mask;
+
+    for (;;) {
+        ConstantEntry *entry = &entries[index];
+
+        if (entry->index == -1 || constant_identical(entry->key, key)) {
+            return entry;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+static void add_constant_entry(Context *context, Value key, int index) {
+    int capacity = context->constants_mask + 1;
+
+    if (context->constants_count + 1 > capacity * 3 / 4) {
+        int new_capacity = Grow_Capacity(capacity);
+        ConstantEntry *entries = malloc(new_capacity * sizeof (ConstantEntry));
+
+        for (int i = 0; i < new_capacity; i++) {
+            entries[i].index = -1;
+        }
+
+        for (int i = 0; i < capacity; i++) {
+            ConstantEntry *entry = &context->constants[i];
+            if (entry->index != -1) {
+                *find_constant(entries, new_capacity - 1, entry->key) = *entry;
+            }
+        }
+
+        free(context->constants);
+        context->constants = entries;
+        context->constants_mask = new_capacity - 1;
+    }
+
+    ConstantEntry *entry = find_constant(context->constants, context->constants_mask, key);
+    entry->key = key;
+    entry->index = index;
+    context->constants_count++;
+}
+
+static inline int make_constant(Parser *parser, Value value) {
+    Context *context = parser->context;
+    Chunk *chunk = parser_chunk(parser);
+
+    // Only numbers and strings (interned) are deduplicated, other
+    // constants (functions) are unique anyway.
+    bool shareable = Is_Num(value) || Is_String(value);
+
+    if (shareable && context->constants_count > 0) {
+        ConstantEntry *entry = find_constant(context->constants, context->constants_mask, value);
+        if (entry->index != -1) {
+            return entry->index;
+        }
+    }
+
+    if (chunk->constants_count == CONST_LIMIT) {
         error_limit(parser, "constants", CONST_LIMIT);
-        parser_chunk(parser)->constants_count = 0;
         return 0;
     }
 
-    return (uint8_t)constant_index;
+    int index = chunk_write_constant(chunk, value);
+    if (shareable) {
+        add_constant_entry(context, value, index);
+    }
+
+    return index;
 }
 
 static inline void emit_constant(Parser *parser, Value value) {
-    emit_bytes(parser, OP_PUSH_CONST, make_constant(parser, value));
+    emit_indexed(parser, OP_PUSH_CONST, make_constant(parser, value));
 }
 
 // Put the name in the constant table as string, and return its index.
-static inline uint8_t identifier_constant(Parser *parser, Token *name) {
+static inline int identifier_constant(Parser *parser, Token *name) {
     RavString *ident = object_string(&parser->vm->allocator, name->lexeme, name->length);
-    return chunk_write_constant(parser_chunk(parser), Obj_Value(ident));
+    return make_constant(parser, Obj_Value(ident));
 }
 
 /** Parser State **/
@@ -299,6 +438,23 @@ static inline bool consume_if(Parser *parser, TokenType type) {
     return true;
 }
 
+// Reserve a new local slot in the context, growing the locals array if needed.
+static Local *push_local(Context *context) {
+    if (context->local_count == context->local_capacity) {
+        context->local_capacity = Grow_Capacity(context->local_capacity);
+        context->locals = realloc(context->locals, context->local_capacity * sizeof (Local));
+    }
+
+    Local *local = &context->locals[context->local_count++];
+
+    RavFunction *function = context->function;
+    if (context->local_count > function->max_slots) {
+        function->max_slots = context->local_count;
+    }
+
+    return local;
+}
+
 static void add_local(Parser *parser, Token name) {
     Context *context = parser->context;
 
@@ -307,7 +463,7 @@ static void add_local(Parser *parser, Token name) {
         return;
     }
 
-    Local *local = &context->locals[context->local_count++];
+    Local *local = push_local(context);
     local->name = name;
     local->depth = -1; // Uninitialized
     local->is_captured = false;
@@ -321,7 +477,7 @@ static void add_dummy_local(Parser* parser) {
         return;
     }
 
-    Local *local = &context->locals[context->local_count++];
+    Local *local = push_local(context);
     local->name = (Token){0};
     local->depth = context->scope_depth;
     local->is_captured = false;
@@ -331,7 +487,10 @@ static inline void begin_scope(Parser *parser) {
     parser->context->scope_depth++;
 }
 
-static void unwind_stack(Parser *parser, int depth) {
+// Emit the popping (or closing) of the locals declared at the given
+// depth or deeper, and return their count. The locals are still declared,
+// so it's used by the jumps out of scopes as well (e.g. continue).
+static int unwind_stack(Parser *parser, int depth) {
     Context *context = parser->context;
     int local_count = 0;
     bool do_closing = false;
@@ -350,24 +509,25 @@ static void unwind_stack(Parser *parser, int depth) {
 
         local_count++;
     }
-    context->local_count -= local_count;
 
     // If no closing occurs, optimize the consecutive pop instructions.
     if (!do_closing && local_count != 0) {
         parser_chunk(parser)->count -= local_count;
-        emit_bytes(parser, OP_POPN, (uint8_t)local_count);
+        emit_indexed(parser, OP_POPN, local_count);
     }
+
+    return local_count;
 }
 
 static void end_scope(Parser *parser, bool loading) {
-    unwind_stack(parser, parser->context->scope_depth);
+    parser->context->local_count -= unwind_stack(parser, parser->context->scope_depth);
 
     // Push the value of the last expression in the block.
     if (loading) {
         Chunk *chunk = parser_chunk(parser);
 
         // If possible optimize out OP_SAVE_X/OP_PUSH_X pattern.
-        if (chunk->opcodes[chunk->count - 1] == OP_POP_X) {
+        if (chunk->count > 0 && chunk->opcodes[chunk->count - 1] == OP_POP_X) {
             chunk->count--;
         } else {
             emit_byte(parser, OP_PUSH_X);
@@ -376,6 +536,32 @@ static void end_scope(Parser *parser, bool loading) {
     parser->context->scope_depth--;
 }
 
+// Enter a loop, whose next iteration starts at the given offset, and
+// whose body locals are declared at the given depth.
+static inline void begin_loop(Parser *parser, Loop *loop, int start, int depth) {
+    loop->enclosing = parser->loop;
+    loop->start = start;
+    loop->depth = depth;
+    loop->breaks = NULL;
+    loop->breaks_count = 0;
+    loop->breaks_capacity = 0;
+
+    parser->loop = loop;
+}
+
+// Leave the innermost loop, its break jumps are patched to jump to the
+// current offset.
+static void end_loop(Parser *parser) {
+    Loop *loop = parser->loop;
+
+    for (int i = 0; i < loop->breaks_count; i++) {
+        patch_jump(parser, loop->breaks[i]);
+    }
+
+    free(loop->breaks);
+    parser->loop = loop->enclosing;
+}
+
 static inline bool same_identifier(Token *a, Token *b) {
     if (a->length != b->length) {
         return false;
@@ -408,7 +594,7 @@ static inline int resolve_local(Context *context, Token *name) {
     return -1;
 }
 
-static int add_upvalue(Parser *parser, Context *context, uint8_t index, bool is_local) {
+static int add_upvalue(Parser *parser, Context *context, int index, bool is_local) {
     int upvalue_count = context->function->upvalue_count;
 
     // Check first if the upvalue is already captured.
@@ -425,6 +611,11 @@ static int add_upvalue(Parser *parser, Context *context, uint8_t index, bool is_
         return 0;
     }
 
+    if (upvalue_count == context->upvalue_capacity) {
+        context->upvalue_capacity = Grow_Capacity(context->upvalue_capacity);
+        context->upvalues = realloc(context->upvalues, context->upvalue_capacity * sizeof (Upvalue));
+    }
+
     context->upvalues[upvalue_count].is_local = is_local;
     context->upvalues[upvalue_count].index = index;
 
@@ -469,12 +660,12 @@ static int resolve_upvalue(Parser *parser, Context *context, Token *name) {
     int local = resolve_local(context->enclosing, name);
     if (local != -1) {
         context->enclosing->locals[local].is_captured = true;
-        return add_upvalue(parser, context, (uint8_t)local, true);
+        return add_upvalue(parser, context, local, true);
     }
 
     int upvalue = resolve_upvalue(parser, context->enclosing, name);
     if (upvalue != -1) {
-        return add_upvalue(parser, context, (uint8_t)upvalue, false);
+        return add_upvalue(parser, context, upvalue, false);
     }
 
     return -1;
@@ -486,8 +677,7 @@ static inline void init_parser(Parser *parser, Lexer *lexer, VM *vm) {
     parser->vm = vm;
     parser->had_error = false;
     parser->panic_mode = false;
-    parser->inner_loop_start = -1;
-    parser->inner_loop_depth = -1;
+    parser->loop = NULL;
 
 #ifdef DEBUG_TRACE_PARSING
     parser->level = 0;
@@ -502,12 +692,20 @@ static inline void init_context(Context *context, Parser *parser, FunctionType t
     parser->context = context;            // Push the new scope.
 
     context->toplevel = type == FunctionToplevel;
+    context->locals = NULL;
     context->local_count = 0;
+    context->local_capacity = 0;
+    context->upvalues = NULL;
+    context->upvalue_capacity = 0;
     context->scope_depth = 0;
+    context->getter_offset = -1;
+    context->constants = NULL;
+    context->constants_count = 0;
+    context->constants_mask = -1;
     context->function = object_function(&parser->vm->allocator);
 
     // Reserve the first slot of the stack for the function itself.
-    Local *local = &context->locals[context->local_count++];
+    Local *local = push_local(context);
     local->depth = 0;
     local->name.lexeme = "";
     local->name.length = 0;
@@ -551,13 +749,21 @@ static inline RavFunction *end_context(Parser *parser, bool toplevel) {
     return function;
 }
 
+// Free the context locals, upvalues and constants lookup arrays, must
+// be called after end_context, once the upvalues are emitted.
+static inline void free_context(Context *context) {
+    free(context->locals);
+    free(context->upvalues);
+    free(context->constants);
+}
+
 // Initialize the most declared local variable.
 static inline void mark_initialized(Context *context) {
     size_t last_index = context->local_count - 1;
     context->locals[last_index].depth = context->scope_depth;
 }
 
-static void define_variable(Parser *parser, uint8_t name_index) {
+static void define_variable(Parser *parser, int name_index) {
     // local scope
     if (parser->context->scope_depth > 0) {
         mark_initialized(parser->context);
@@ -565,7 +771,7 @@ static void define_variable(Parser *parser, uint8_t name_index) {
     }
 
     // global scope
-    emit_bytes(parser, OP_DEF_GLOBAL, name_index);
+    emit_indexed(parser, OP_DEF_GLOBAL, name_index);
 }
 
 /** Parsing **/
@@ -573,12 +779,13 @@ static void define_variable(Parser *parser, uint8_t name_index) {
 static void number(Parser*);
 static void string(Parser*);
 static void parse_precedence(Parser*, Precedence);
+static void parse_infix(Parser*, Precedence);
 static void expression(Parser*);
 static void declaration(Parser*);
 static void function(Parser*, FunctionType);
 static inline ParseRule *token_rule(TokenType);
 
-static uint8_t variable(Parser *parser, const char *error) {
+static int variable(Parser *parser, const char *error) {
     consume(parser, TOKEN_IDENTIFIER, error);
 
     // global scope
@@ -627,25 +834,41 @@ static void assignment(Parser *parser) {
     }
 
     // Check if the left hand side was an identifier, it's kind of a hack.
-    // If it's an identifier, the last written opcode should be one of
-    // these getters opcodes.
-    uint8_t opcode = chunk->opcodes[chunk->count - 2];
-    if (opcode != OP_GET_GLOBAL &&
-        opcode != OP_GET_LOCAL &&
-        opcode != OP_GET_UPVALUE) {
+    // If it's an identifier, the last written instruction should be one
+    // of the getters instructions.
+    int offset = parser->context->getter_offset;
+    uint8_t opcode = offset == -1 ? OP_EXIT : chunk->opcodes[offset];
+
+    bool narrow = offset + 2 == chunk->count && (opcode == OP_GET_GLOBAL ||
+                                                 opcode == OP_GET_LOCAL ||
+                                                 opcode == OP_GET_UPVALUE);
+
+    bool wide = offset + 3 == chunk->count && (opcode == OP_GET_GLOBAL_16 ||
+                                               opcode == OP_GET_LOCAL_16 ||
+                                               opcode == OP_GET_UPVALUE_16);
+
+    if (!narrow && !wide) {
         error_previous(parser, "invalid assignment target");
         return;
     }
 
     // Get slot index of the variable and extract the corresponding
     // set instruction, and then discard the get instruction.
-    uint8_t index = chunk->opcodes[chunk->count - 1];
+    int index = wide
+        ? chunk->opcodes[offset + 1] << 8 | chunk->opcodes[offset + 2]
+        : chunk->opcodes[offset + 1];
     uint8_t set_op = opcode - 1;
-    chunk->count -= 2;
+    chunk->count = offset;
 
     // Not PREC_ASSIGNMENT + 1, since assignment is right associated.
     parse_precedence(parser, PREC_ASSIGNMENT);
-    emit_bytes(parser, set_op, index);
+
+    if (wide) {
+        emit_byte(parser, set_op);
+        emit_bytes(parser, (index >> 8) & 0xff, index & 0xff);
+    } else {
+        emit_bytes(parser, set_op, (uint8_t)index);
+    }
 
     Debug_Exit(parser);
 }
@@ -653,9 +876,25 @@ static void assignment(Parser *parser) {
 static void cons(Parser *parser) {
     Debug_Log(parser);
 
-    // Not PREC_CONS + 1, since cons is right associated operator.
-    parse_precedence(parser, PREC_CONS);
-    emit_byte(parser, OP_CONS);
+    // Cons is right associated, the whole chain is parsed at once, so its
+    // heads and tail are pushed, then the list is built from the end in
+    // chunks of at most 255 heads, each one is the tail of the next.
+    int count = 1;
+    parse_precedence(parser, PREC_CONS + 1);
+    while (consume_if(parser, TOKEN_COLON_COLON)) {
+        parse_precedence(parser, PREC_CONS + 1);
+        count++;
+    }
+
+    while (count > 0) {
+        int heads = count < UINT8_MAX ? count : UINT8_MAX;
+        if (heads == 1) {
+            emit_byte(parser, OP_CONS);
+        } else {
+            emit_bytes(parser, OP_LIST, (uint8_t)heads);
+        }
+        count -= heads;
+    }
 
     Debug_Exit(parser);
 }
@@ -823,7 +1062,7 @@ static void function_block(Parser *parser) {
     Chunk *chunk = parser_chunk(parser);
 
     // If possible optimize out OP_SAVE_X/OP_PUSH_X pattern.
-    if (chunk->opcodes[chunk->count - 1] == OP_POP_X) {
+    if (chunk->count > 0 && chunk->opcodes[chunk->count - 1] == OP_POP_X) {
         chunk->count--;
     } else {
         emit_byte(parser, OP_PUSH_X);
@@ -952,7 +1191,7 @@ static void pattern_fail_if_true(Parser *parser, Pattern_Context *context, bool
     int success_jump = emit_jump(parser, OP_JMP_POP_FALSE);                 // ---- false
                                                                             //    |
     // Unwind the binding introduced by the failed pattern.                 //    |
-    emit_bytes(parser, OP_POPN, (uint8_t)(values_count));                   //    |
+    emit_indexed(parser, OP_POPN, values_count);                            //    |
                                                                             //    |
     // Finally jump to the next case, as the pattern didn't match.          //    |
     context->cases_next[context->cases_count] = emit_jump(parser, OP_JMP);  // -------
@@ -987,7 +1226,7 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
         }
 
         // Identifier Pattern
-        uint8_t index = variable(parser, "");
+        int index = variable(parser, "");
         define_variable(parser, index);
         context->bindings_count += 1;
         break;
@@ -1037,7 +1276,7 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
 
         // Index of the recent match value on stack.
         add_dummy_local(parser);
-        uint8_t match_value_index = parser->context->local_count - 1;
+        int match_value_index = parser->context->local_count - 1;
 
         // Compile the left side pattern.
         emit_bytes(parser, OP_DUP, OP_CAR);
@@ -1046,7 +1285,7 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
         consume(parser, TOKEN_COLON_COLON, "expect '::' in pair pattern");
 
         // Retrieve the match value to the stack top.
-        emit_bytes(parser, OP_GET_LOCAL, match_value_index);
+        emit_indexed(parser, OP_GET_LOCAL, match_value_index);
 
         // Compile the right side pattern.
         emit_byte(parser, OP_CDR);
@@ -1065,13 +1304,13 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
 
         // Index of the recent match value on stack.
         add_dummy_local(parser);
-        uint8_t match_value_index = parser->context->local_count - 1;
+        int match_value_index = parser->context->local_count - 1;
 
         // Save a copy of the array length on the stack.
         emit_bytes(parser, OP_DUP, OP_ARRAY_LEN);
         add_dummy_local(parser);
         context->bindings_count += 1;
-        uint8_t length_index = parser->context->local_count - 1;
+        int length_index = parser->context->local_count - 1;
 
         // Check for empty array pattern.
         if (consume_if(parser, TOKEN_RIGHT_BRACKET)) {
@@ -1084,13 +1323,13 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
         int array_subpatterns_count = 0;
         do {
             // Check that `array_length` >= `array_subpatterns_count`
-            emit_bytes(parser, OP_GET_LOCAL, length_index);
+            emit_indexed(parser, OP_GET_LOCAL, length_index);
             emit_constant(parser, Num_Value(array_subpatterns_count + 1));
             emit_byte(parser, OP_LT);
             pattern_fail_if_true(parser, context, subvalue);
 
             // Compile array element.
-            emit_bytes(parser, OP_GET_LOCAL, match_value_index);
+            emit_indexed(parser, OP_GET_LOCAL, match_value_index);
             emit_bytes(parser, OP_ARRAY_PUSH_ELEMENT, (uint8_t)array_subpatterns_count);
             pattern(parser, context, true);
 
@@ -1098,7 +1337,7 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
         } while (consume_if(parser, TOKEN_COMMA));
 
         // Check that the pattern count equals the array element count.
-        emit_bytes(parser, OP_GET_LOCAL, length_index);
+        emit_indexed(parser, OP_GET_LOCAL, length_index);
         emit_constant(parser, Num_Value(array_subpatterns_count));
         emit_byte(parser, OP_NEQ);
         pattern_fail_if_true(parser, context, subvalue);
@@ -1121,7 +1360,7 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
 
         // The recent match value
         add_dummy_local(parser);
-        uint8_t match_value_index = parser->context->local_count - 1;
+        int match_value_index = parser->context->local_count - 1;
 
         do {
             consume(parser, TOKEN_IDENTIFIER, "expect key name for the map pattern");
@@ -1134,9 +1373,9 @@ pattern(Parser *parser, Pattern_Context *context, bool subvalue) {
 
             // OP_MAP_GET sets the X register to true or false depending
             // on whether the map has the key or not
-            uint8_t constant_index = make_constant(parser, Obj_Value(key));
-            emit_bytes(parser, OP_GET_LOCAL, match_value_index);
-            emit_bytes(parser, OP_MAP_PUSH_ELEMENT, constant_index);
+            int constant_index = make_constant(parser, Obj_Value(key));
+            emit_indexed(parser, OP_GET_LOCAL, match_value_index);
+            emit_indexed(parser, OP_MAP_PUSH_ELEMENT, constant_index);
             emit_bytes(parser, OP_PUSH_X, OP_NOT);
             pattern_fail_if_true(parser, context, subvalue);
 
@@ -1181,7 +1420,7 @@ static void match(Parser *parser) {
 
         // Save the expression value in X and rewind the stack.
         emit_byte(parser, OP_POP_X);
-        unwind_stack(parser, parser->context->scope_depth);
+        parser->context->local_count -= unwind_stack(parser, parser->context->scope_depth);
         emit_byte(parser, OP_PUSH_X);
         cases_exit[cases_count++] = emit_jump(parser, OP_JMP);
 
@@ -1215,6 +1454,9 @@ static void while_(Parser *parser) {
     // [continue]              |  |
     // OP_JMP_BACK        --------|
     //                         |  |
+    // [break]                 |  |
+    // OP_JMP             -----|  |
+    //                         |  |
     // Loop Body               |  |
     // OP_JMP_BACK        ---------
     //                         |
@@ -1222,15 +1464,10 @@ static void while_(Parser *parser) {
 
     Debug_Log(parser);
 
-    // Register the surrounding loop state.
-    int previous_inner_loop_start = parser->inner_loop_start;
-    int previous_inner_loop_depth = parser->inner_loop_depth;
-
+    // Push the current loop state, the body is a nested scope.
+    Loop loop;
     int loop_start = parser_chunk(parser)->count;             // <-----.
-                                                              //       |
-    // Push the current loop state                            //       |
-    parser->inner_loop_start = loop_start;                    //       |
-    parser->inner_loop_depth = parser->context->scope_depth;  //       |
+    begin_loop(parser, &loop, loop_start, parser->context->scope_depth + 1);
                                                               //       |
     expression(parser); // Condition                          //       |
                                                               //       |
@@ -1244,12 +1481,87 @@ static void while_(Parser *parser) {
                                                               //    |
     patch_jump(parser, exit_jump);                            // <---
 
+    // Pop the current loop state, and patch its breaks.
+    end_loop(parser);
+
     // The resulting expression of a loop is always nil.
     emit_byte(parser, OP_PUSH_NIL);
 
-    // Pop the current loop state.
-    parser->inner_loop_start = previous_inner_loop_start;
-    parser->inner_loop_depth = previous_inner_loop_depth;
+    Debug_Exit(parser);
+}
+
+static void for_(Parser *parser) {
+    // For Control Flow
+    //
+    // Subject (or range start, range end)
+    // OP_ITER_INIT
+    // OP_ITER_NEXT       -----.  <----.
+    //                         |       |
+    // [continue]              |       |
+    // OP_JMP_BACK        -------------|
+    //                         |       |
+    // [break]                 |       |
+    // OP_JMP             -----|       |
+    //                         |       |
+    // Loop Body               |       |
+    // OP_JMP_BACK        --------------
+    //                         |
+    // OP_POPN 4       <--------
+    //
+    // The subject, its end, the resizes of maps and the iteration state are
+    // kept in four hidden locals, the next element is pushed by OP_ITER_NEXT
+    // as the loop variable.
+
+    Debug_Log(parser);
+
+    consume(parser, TOKEN_IDENTIFIER, "expect a loop variable name");
+    Token name = parser->previous;
+    consume(parser, TOKEN_IN, "expect 'in' after loop variable");
+
+    begin_scope(parser);
+
+    // The subject is parsed above the concatenation precedence, so the
+    // '..' of a range isn't taken as a concatenation.
+    parse_precedence(parser, PREC_TERM);
+    bool range = consume_if(parser, TOKEN_DOT_DOT);
+    if (range) {
+        parse_precedence(parser, PREC_TERM);
+    } else {
+        parse_infix(parser, PREC_OR);
+    }
+
+    consume(parser, TOKEN_DO, "expect 'do' after for subject");
+
+    emit_bytes(parser, OP_ITER_INIT, range);
+    add_dummy_local(parser); // Subject
+    add_dummy_local(parser); // End
+    add_dummy_local(parser); // Resizes
+    add_dummy_local(parser); // State
+
+    int loop_start = parser_chunk(parser)->count;
+    int exit_jump = emit_jump(parser, OP_ITER_NEXT);
+
+    begin_scope(parser);
+    add_local(parser, name);
+    mark_initialized(parser->context);
+
+    Loop loop;
+    begin_loop(parser, &loop, loop_start, parser->context->scope_depth);
+
+    while (!current_is(parser, TOKEN_END) && !current_is(parser, TOKEN_EOF)) {
+        declaration(parser);
+    }
+
+    consume(parser, TOKEN_END, "expect closing 'end' after loop block");
+
+    end_scope(parser, false);
+    emit_loop(parser, loop_start);
+    patch_jump(parser, exit_jump);
+    end_loop(parser);
+    end_scope(parser, false);
+
+    // The resulting expression of a loop is always nil.
+    emit_byte(parser, OP_PUSH_NIL);
 
     Debug_Exit(parser);
 }
@@ -1309,7 +1621,8 @@ static void identifier(Parser *parser) {
         }
     }
 
-    emit_bytes(parser, get_op, index);
+    parser->context->getter_offset = parser_chunk(parser)->count;
+    emit_indexed(parser, get_op, index);
 
     Debug_Exit(parser);
 }
@@ -1317,8 +1630,12 @@ static void identifier(Parser *parser) {
 static void number(Parser *parser) {
     Debug_Log(parser);
 
-    Value value = Num_Value(strtod(parser->previous.lexeme, NULL));
-    emit_constant(parser, value);
+    double number;
+    if (!number_parse(parser->previous.lexeme, parser->previous.length, &number)) {
+        error_previous(parser, "invalid number literal");
+    }
+
+    emit_constant(parser, Num_Value(number));
 
     Debug_Exit(parser);
 }
@@ -1337,20 +1654,36 @@ static void string(Parser *parser) {
     Debug_Exit(parser);
 }
 
+// Count a part pushed to the stack by the interpolated string, and
+// fold the parts if their count reached the instruction limit.
+static void interpolated_part(Parser *parser, int *parts) {
+    if (++*parts == UINT8_MAX) {
+        emit_bytes(parser, OP_INTERPOLATE, UINT8_MAX);
+        *parts = 1;
+    }
+}
+
 static void string_interpolated(Parser *parser) {
     Debug_Log(parser);
 
-    Allocator *allocator = &parser->vm->allocator;
-    RavString *begin = object_string(
-        allocator,
-        parser->previous.lexeme + 1, // +1 advances the double quote
-        parser->previous.length - 3  // -3 for the delimiters count
-    );
-    emit_constant(parser, Obj_Value(begin));
+    // All the parts are pushed to the stack, and joined at once.
+    int parts = 0;
+
+    int begin_length = parser->previous.length - 3; // -3 for the delimiters count
+    if (begin_length != 0) {
+        Allocator *allocator = &parser->vm->allocator;
+        RavString *begin = object_string(
+            allocator,
+            parser->previous.lexeme + 1, // +1 advances the double quote
+            begin_length
+        );
+        emit_constant(parser, Obj_Value(begin));
+        interpolated_part(parser, &parts);
+    }
 
     while (parser->previous.type != TOKEN_STRING_END) {
         expression(parser);
-        emit_byte(parser, OP_CONCAT);
+        interpolated_part(parser, &parts);
 
         bool string_part = consume_if(parser, TOKEN_STRING_PART);
         bool string_end = consume_if(parser, TOKEN_STRING_END);
@@ -1369,9 +1702,10 @@ static void string_interpolated(Parser *parser) {
             }
 
             if (length != 0) {
+                Allocator *allocator = &parser->vm->allocator;
                 RavString *part = object_string(allocator, chars, length);
                 emit_constant(parser, Obj_Value(part));
-                emit_byte(parser, OP_CONCAT);
+                interpolated_part(parser, &parts);
             }
         } else {
             error_current(parser, "ill-formed interpolated string");
@@ -1379,6 +1713,8 @@ static void string_interpolated(Parser *parser) {
         }
     }
 
+    emit_bytes(parser, OP_INTERPOLATE, parts);
+
     Debug_Exit(parser);
 }
 
@@ -1515,7 +1851,7 @@ static ParseRule rules[] = {
     { NULL,                 NULL,       PREC_NONE },         // TOKEN_ELSE
     { boolean,              NULL,       PREC_NONE },         // TOKEN_FALSE
     { NULL,                 NULL,       PREC_NONE },         // TOKEN_FN
-    { NULL,                 NULL,       PREC_NONE },         // TOKEN_FOR
+    { for_,                 NULL,       PREC_NONE },         // TOKEN_FOR
     { if_,                  NULL,       PREC_NONE },         // TOKEN_IF
     { NULL,                 NULL,       PREC_NONE },         // TOKEN_IN
     { NULL,                 NULL,       PREC_NONE },         // TOKEN_LET
@@ -1583,12 +1919,18 @@ static void parse_precedence(Parser *parser, Precedence precedence) {
     }
 
     prefix(parser);
+    parse_infix(parser, precedence);
+
+    Debug_Exit(parser);
+}
+
+// Parse the infix operators following an already parsed operand, with
+// the given precedence or higher.
+static void parse_infix(Parser *parser, Precedence precedence) {
     while (precedence <= token_rule(parser->current.type)->precedence) {
         advance(parser);
         token_rule(parser->previous.type)->infix(parser);
     }
-
-    Debug_Exit(parser);
 }
 
 static void expression(Parser *parser) {
@@ -1598,7 +1940,7 @@ static void expression(Parser *parser) {
 static void let_declaration(Parser *parser) {
     Debug_Log(parser);
 
-    uint8_t index = variable(parser, "expect a variable name");
+    int index = variable(parser, "expect a variable name");
 
     if (consume_if(parser, TOKEN_EQUAL)) {
         expression(parser);
@@ -1622,7 +1964,7 @@ static void parameters(Parser *parser, TokenType closing_token) {
             error_limit(parser, "parameters", 255);
         }
 
-        uint8_t index = variable(parser, "expect parameter name");
+        int index = variable(parser, "expect parameter name");
         define_variable(parser, index);
     } while (consume_if(parser, TOKEN_COMMA));
 
@@ -1634,6 +1976,10 @@ static void function(Parser *parser, FunctionType type) {
     init_context(&context, parser, type);
     begin_scope(parser);
 
+    // The loops of the surrounding function can't be continued or broken.
+    Loop *enclosing_loop = parser->loop;
+    parser->loop = NULL;
+
     if (type == FunctionDeclaration) {
         consume(parser, TOKEN_LEFT_PAREN, "expect '(' after name");
         parameters(parser, TOKEN_RIGHT_PAREN);
@@ -1647,20 +1993,25 @@ static void function(Parser *parser, FunctionType type) {
         assert(!"invalid function type");
     }
 
+    parser->loop = enclosing_loop;
+
     RavFunction *function = end_context(parser, false);
-    uint8_t index = make_constant(parser, Obj_Value(function));
-    emit_bytes(parser, OP_CLOSURE, index);
+    int index = make_constant(parser, Obj_Value(function));
+    emit_indexed(parser, OP_CLOSURE, index);
 
     for (int i = 0; i < function->upvalue_count; i++) {
+        uint16_t upvalue_index = context.upvalues[i].index;
         emit_byte(parser, context.upvalues[i].is_local ? 1 : 0);
-        emit_byte(parser, context.upvalues[i].index);
+        emit_bytes(parser, (upvalue_index >> 8) & 0xff, upvalue_index & 0xff);
     }
+
+    free_context(&context);
 }
 
 static void fn_declaration(Parser *parser) {
     Debug_Log(parser);
 
-    uint8_t index = variable(parser, "expect a function name");
+    int index = variable(parser, "expect a function name");
 
     if (parser->context->scope_depth > 0) {
         mark_initialized(parser->context);
@@ -1694,12 +2045,36 @@ static void continue_statement(Parser *parser) {
     Debug_Log(parser);
 
     // In a loop?
-    if (parser->inner_loop_start == -1) {
+    Loop *loop = parser->loop;
+    if (loop == NULL) {
         error_previous(parser, "use of continue outside a loop");
+        return;
     }
 
-    unwind_stack(parser, parser->inner_loop_depth);
-    emit_loop(parser, parser->inner_loop_start);
+    unwind_stack(parser, loop->depth);
+    emit_loop(parser, loop->start);
+
+    Debug_Exit(parser);
+}
+
+static void break_statement(Parser *parser) {
+    Debug_Log(parser);
+
+    // In a loop?
+    Loop *loop = parser->loop;
+    if (loop == NULL) {
+        error_previous(parser, "use of break outside a loop");
+        return;
+    }
+
+    // Pop (or close) the loop body locals, and jump to the loop exit.
+    unwind_stack(parser, loop->depth);
+
+    if (loop->breaks_count == loop->breaks_capacity) {
+        loop->breaks_capacity = Grow_Capacity(loop->breaks_capacity);
+        loop->breaks = realloc(loop->breaks, loop->breaks_capacity * sizeof (int));
+    }
+    loop->breaks[loop->breaks_count++] = emit_jump(parser, OP_JMP);
 
     Debug_Exit(parser);
 }
@@ -1738,6 +2113,8 @@ static void declaration(Parser *parser) {
         return_statement(parser);
     } else if (consume_if(parser, TOKEN_CONTINUE)) {
         continue_statement(parser);
+    } else if (consume_if(parser, TOKEN_BREAK)) {
+        break_statement(parser);
     } else {
         expression(parser);
         emit_byte(parser, OP_POP_X);
@@ -1765,5 +2142,7 @@ RavFunction *compile(VM *vm, const char *source, const char *file) {
     }
 
     RavFunction *function = end_context(&parser, true);
+    free_context(&context);
+
     return parser.had_error ? NULL : function;
 }
@@ -17,6 +17,18 @@ static int const_instruction(const char *tag, Chunk *chunk, int offset) {
     return offset + 2;
 }
 
+static int const_16_instruction(const char *tag, Chunk *chunk, int offset) {
+    uint16_t constant_index = (uint16_t)(
+        chunk->opcodes[offset + 1] << 8 |
+        chunk->opcodes[offset + 2]
+    );
+
+    printf("%-16s %4x = ", tag, constant_index);
+    value_print(chunk->constants[constant_index]);
+    printf("\n");
+    return offset + 3;
+}
+
 static int byte_instruction(const char *tag, Chunk *chunk, int offset) {
     uint8_t count = chunk->opcodes[offset + 1];
     printf("%-16s %4d\n", tag, count);
@@ -43,21 +55,28 @@ static int jump_instruction(const char *tag, Chunk *chunk, int sign, int offset)
     return offset + 3;
 }
 
-static int closure_instruction(Chunk *chunk, int offset) {
+static int closure_instruction(const char *tag, Chunk *chunk, bool wide, int offset) {
     offset++;
-    uint8_t index = chunk->opcodes[offset++];
+    uint16_t index = chunk->opcodes[offset++];
+    if (wide) {
+        index = (uint16_t)(index << 8 | chunk->opcodes[offset++]);
+    }
     Value value = chunk->constants[index];
 
-    printf("%-16s %4d ", "CLOSURE", index);
+    printf("%-16s %4d ", tag, index);
     value_print(value);
     putchar('\n');
 
     RavFunction *function = As_Function(value);
     for (int i = 0; i < function->upvalue_count; i++) {
-        uint8_t is_local = chunk->opcodes[offset++];
-        uint8_t index = chunk->opcodes[offset++];
+        uint8_t is_local = chunk->opcodes[offset];
+        uint16_t index = (uint16_t)(
+            chunk->opcodes[offset + 1] << 8 |
+            chunk->opcodes[offset + 2]
+        );
         printf("%04d     |                     %s %d\n",
-               offset - 2, is_local ? "local" : "upvalue", index);
+               offset, is_local ? "local" : "upvalue", index);
+        offset += 3;
     }
 
     return offset;
@@ -88,6 +107,9 @@ int disassemble_instruction(Chunk *chunk, int offset) {
     case OP_PUSH_CONST:
         return const_instruction("PUSH_CONST", chunk, offset);
 
+    case OP_PUSH_CONST_16:
+        return const_16_instruction("PUSH_CONST_16", chunk, offset);
+
     case OP_PUSH_X:
         return basic_instruction("PUSH_X", offset);
 
@@ -103,6 +125,9 @@ int disassemble_instruction(Chunk *chunk, int offset) {
     case OP_POPN:
         return byte_instruction("POPN", chunk, offset);
 
+    case OP_POPN_16:
+        return short_instruction("POPN_16", chunk, offset);
+
     case OP_ADD:
         return basic_instruction("ADD", offset);
 
@@ -163,6 +188,27 @@ int disassemble_instruction(Chunk *chunk, int offset) {
     case OP_GET_UPVALUE:
         return byte_instruction("GET_UPVALUE", chunk, offset);
 
+    case OP_DEF_GLOBAL_16:
+        return short_instruction("DEF_GLOBAL_16", chunk, offset);
+
+    case OP_SET_GLOBAL_16:
+        return short_instruction("SET_GLOBAL_16", chunk, offset);
+
+    case OP_GET_GLOBAL_16:
+        return short_instruction("GET_GLOBAL_16", chunk, offset);
+
+    case OP_SET_LOCAL_16:
+        return short_instruction("SET_LOCAL_16", chunk, offset);
+
+    case OP_GET_LOCAL_16:
+        return short_instruction("GET_LOCAL_16", chunk, offset);
+
+    case OP_SET_UPVALUE_16:
+        return short_instruction("SET_UPVALUE_16", chunk, offset);
+
+    case OP_GET_UPVALUE_16:
+        return short_instruction("GET_UPVALUE_16", chunk, offset);
+
     case OP_CALL:
         return byte_instruction("CALL", chunk, offset);
 
@@ -178,8 +224,17 @@ int disassemble_instruction(Chunk *chunk, int offset) {
     case OP_JMP_POP_FALSE:
         return jump_instruction("JMP_POP_FALSE", chunk, 1, offset);
 
+    case OP_ITER_INIT:
+        return byte_instruction("ITER_INIT", chunk, offset);
+
+    case OP_ITER_NEXT:
+        return jump_instruction("ITER_NEXT", chunk, 1, offset);
+
     case OP_CLOSURE:
-        return closure_instruction(chunk, offset);
+        return closure_instruction("CLOSURE", chunk, false, offset);
+
+    case OP_CLOSURE_16:
+        return closure_instruction("CLOSURE_16", chunk, true, offset);
 
     case OP_CLOSE_UPVALUE:
         return basic_instruction("CLOSE_UPVALUE", offset);
@@ -187,9 +242,15 @@ int disassemble_instruction(Chunk *chunk, int offset) {
     case OP_CONCAT:
         return basic_instruction("CONCAT", offset);
 
+    case OP_INTERPOLATE:
+        return byte_instruction("INTERPOLATE", chunk, offset);
+
     case OP_CONS:
         return basic_instruction("CONS", offset);
 
+    case OP_LIST:
+        return byte_instruction("LIST", chunk, offset);
+
     case OP_ARRAY_8:
         return byte_instruction("ARRAY_8", chunk, offset);
 
@@ -223,6 +284,9 @@ int disassemble_instruction(Chunk *chunk, int offset) {
     case OP_MAP_PUSH_ELEMENT:
         return const_instruction("MAP_PUSH_ELEMENT", chunk, offset);
 
+    case OP_MAP_PUSH_ELEMENT_16:
+        return const_16_instruction("MAP_PUSH_ELEMENT_16", chunk, offset);
+
     case OP_IS_PAIR:
         return basic_instruction("IS_PAIR", offset);
 
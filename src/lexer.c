@@ -266,6 +266,17 @@ static Token number(Lexer *lexer) {
         while (isdigit(peek(lexer))) advance(lexer);
     }
 
+    // exponent, only if followed by digits (e.g. 1e10, 2.5e-3)
+    if (peek(lexer) == 'e' || peek(lexer) == 'E') {
+        const char *exponent = lexer->current + 1;
+        if (*exponent == '+' || *exponent == '-') exponent++;
+
+        if (isdigit(*exponent)) {
+            lexer->current = exponent;
+            while (isdigit(peek(lexer))) advance(lexer);
+        }
+    }
+
     return new_token(lexer, TOKEN_NUMBER);
 }
 
@@ -1,26 +1,42 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "mem.h"
 #include "object.h"
 #include "table.h"
 
 #ifdef DEBUG_TRACE_MEMORY
-#include <stdio.h>
 #include "debug.h"
 #endif
 
 void allocator_init(Allocator *allocator) {
-    allocator->objects = NULL;
+    for (int i = 0; i < HEAP_CLASSES; i++) {
+        allocator->pages[i] = NULL;
+        allocator->available[i] = NULL;
+    }
     allocator->gray_stack = NULL;
     allocator->gray_count = 0;
     allocator->gray_capacity = 0;
     allocator->bytes_allocated = 0;
     allocator->next_gc = GC_INITIAL_NEXT;
     allocator->gc_off = false;
+    allocator->regions = NULL;
     table_init(&allocator->strings);
+    table_init(&allocator->pairs);
 }
 
-static void free_object(Allocator *allocator, Object *object) {
+// A free slot of a heap page.
+typedef struct Slot {
+    struct Slot *next;
+} Slot;
+
+// Free the memory owned by the object, and return its slot to the page.
+static void free_object(Allocator *allocator, Page *page, Object *object) {
 #ifdef DEUBG_TRACE_MEMORY
     printf("[Memory] %p : free type %d\n", object, object->type);
 #endif
@@ -28,74 +44,171 @@ static void free_object(Allocator *allocator, Object *object) {
     switch (object->type) {
     case OBJ_STRING: {
         RavString *string = (RavString *)object;
-        Free_Array(allocator, char, string->chars, string->length + 1);
-        Free(allocator, RavString, string);
-        break;
-    }
-
-    case OBJ_PAIR: {
-        Free(allocator, RavPair, object);
+        if (string->borrowed) {
+            allocator_release(allocator, string->chars);
+        } else {
+            Free_Array(allocator, char, string->chars, string->length + 1);
+        }
         break;
     }
 
     case OBJ_ARRAY: {
         RavArray *array = (RavArray *)object;
-        Free_Array(allocator, Value, array->values, array->capacity);
-        Free(allocator, RavArray, array);
+        if (array->packed) {
+            Free_Array(allocator, double, array->numbers, array->capacity);
+        } else {
+            Free_Array(allocator, Value, array->values, array->capacity);
+        }
         break;
     }
 
     case OBJ_MAP: {
         RavMap *map = (RavMap *)object;
-        table_free(&map->table);
-        Free(allocator, RavMap, map);
+        dict_free(&map->dict);
         break;
     }
 
     case OBJ_FUNCTION: {
         RavFunction *function = (RavFunction *)object;
+        if (function->chunk.borrowed) {
+            allocator_release(allocator, function->chunk.opcodes);
+        }
         chunk_free(&function->chunk);
-        Free(allocator, RavFunction, function);
-        break;
-    }
-
-    case OBJ_UPVALUE: {
-        Free(allocator, RavUpvalue, object);
         break;
     }
 
     case OBJ_CLOSURE: {
         RavClosure *closure = (RavClosure *)object;
         Free_Array(allocator, RavClosure*, closure->upvalues, closure->upvalue_count);
-        Free(allocator, RavClosure, object);
         break;
     }
 
-    case OBJ_CFUNCTION: {
-        Free(allocator, RavCFunction, object);
+    case OBJ_FILE: {
+        RavFile *file = (RavFile *)object;
+        object_file_close(file);
+        if (file->mapped) {
+            munmap(file->data, file->size);
+        }
         break;
     }
 
+    case OBJ_PAIR:
+    case OBJ_UPVALUE:
+    case OBJ_CFUNCTION:
+    case OBJ_SLICE:
+        break;
+
     default:
         assert(!"invalid object type");
     }
+
+    allocator->bytes_allocated -= page->slot_size;
+    Slot *slot = (Slot *)object;
+    slot->next = page->free;
+    page->free = slot;
 }
 
 void allocator_free(Allocator *allocator) {
     table_free(&allocator->strings);
+    table_free(&allocator->pairs);
     free(allocator->gray_stack);
 
-    Object *objects = allocator->objects;
-    while (objects) {
-        Object *next = objects->next;
-        free_object(allocator, objects);
-        objects = next;
+    for (int i = 0; i < HEAP_CLASSES; i++) {
+        Page *page = allocator->pages[i];
+        while (page != NULL) {
+            for (int j = 0; j < HEAP_PAGE_WORDS; j++) {
+                for (uint64_t live = page->live[j]; live != 0; live &= live - 1) {
+                    size_t grain = j * 64 + __builtin_ctzll(live);
+                    free_object(allocator, page, (Object *)((char *)page + grain * HEAP_GRAIN));
+                }
+            }
+
+            Page *next = page->next;
+            munmap(page, HEAP_PAGE_SIZE);
+            page = next;
+        }
+    }
+
+    // Regions still held by their loaders.
+    while (allocator->regions) {
+        Region *region = allocator->regions;
+        allocator->regions = region->next;
+        munmap((void *)region->start, region->size);
+        free(region);
     }
 
     allocator_init(allocator);
 }
 
-void *allocate(Allocator *allocator, void *previous, size_t old_size, size_t new_size) {
+const void *allocator_map(Allocator *allocator, const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat file;
+    if (fstat(fd, &file) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // Empty files can't be mapped.
+    if (file.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    void *start = mmap(NULL, file.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (start == MAP_FAILED) {
+        return NULL;
+    }
+
+    Region *region = malloc(sizeof (Region));
+    region->start = start;
+    region->size = file.st_size;
+    region->references = 1;
+    region->next = allocator->regions;
+    allocator->regions = region;
+
+    *size = file.st_size;
+    return start;
+}
+
+// Return the link to the region containing the given address.
+static Region **find_region(Allocator *allocator, const void *pointer) {
+    const char *address = pointer;
+
+    for (Region **link = &allocator->regions; *link != NULL; link = &(*link)->next) {
+        const char *start = (*link)->start;
+        if (address >= start && address < start + (*link)->size) {
+            return link;
+        }
+    }
+
+    assert(!"address of unknown region");
+    return NULL;
+}
+
+void allocator_retain(Allocator *allocator, const void *pointer) {
+    (*find_region(allocator, pointer))->references++;
+}
+
+void allocator_release(Allocator *allocator, const void *pointer) {
+    Region **link = find_region(allocator, pointer);
+    Region *region = *link;
+
+    if (--region->references == 0) {
+        munmap((void *)region->start, region->size);
+        *link = region->next;
+        free(region);
+    }
+}
+
+// Account the allocated memory, and start a GC round if needed.
+static void account(Allocator *allocator, size_t old_size, size_t new_size) {
     allocator->bytes_allocated += new_size - old_size;
 
     if (!allocator->gc_off && new_size > old_size) {
@@ -107,6 +220,10 @@ void *allocate(Allocator *allocator, void *previous, size_t old_size, size_t new
         }
 #endif
     }
+}
+
+void *allocate(Allocator *allocator, void *previous, size_t old_size, size_t new_size) {
+    account(allocator, old_size, new_size);
 
     if (new_size == 0) {
         free(previous);
@@ -116,9 +233,77 @@ void *allocate(Allocator *allocator, void *previous, size_t old_size, size_t new
     return realloc(previous, new_size);
 }
 
+// Construct an empty page of the given size class, with free slots.
+static Page *new_page(Allocator *allocator, int class) {
+    // Map twice the size, and unmap the parts around the aligned page.
+    char *memory = mmap(NULL, 2 * HEAP_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *start = (char *)(((uintptr_t)memory + HEAP_PAGE_SIZE - 1) & ~(uintptr_t)(HEAP_PAGE_SIZE - 1));
+    if (start > memory) {
+        munmap(memory, start - memory);
+    }
+    munmap(start + HEAP_PAGE_SIZE, memory + HEAP_PAGE_SIZE - start);
+
+    // Mapped memory is zeroed.
+    Page *page = (Page *)start;
+    page->slot_size = (class + 1) * HEAP_GRAIN;
+    page->bump = (char *)page + sizeof (Page);
+    page->end = page->bump + (HEAP_PAGE_SIZE - sizeof (Page)) / page->slot_size * page->slot_size;
+
+    page->next = allocator->pages[class];
+    allocator->pages[class] = page;
+    page->available = allocator->available[class];
+    allocator->available[class] = page;
+    return page;
+}
+
+Object *allocate_object(Allocator *allocator, size_t size) {
+    int class = (size - 1) / HEAP_GRAIN;
+
+    account(allocator, 0, (class + 1) * HEAP_GRAIN);
+
+    Page *page = allocator->available[class];
+    if (page == NULL) {
+        page = new_page(allocator, class);
+    }
+
+    if (page == NULL) {
+        vm_flush((VM *)allocator);
+        fprintf(stderr, "Fatal: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Object *object;
+    if (page->free != NULL) {
+        object = (Object *)page->free;
+        page->free = page->free->next;
+    } else {
+        object = (Object *)page->bump;
+        page->bump += page->slot_size;
+    }
+
+    if (page->free == NULL && page->bump == page->end) {
+        allocator->available[class] = page->available;
+    }
+
+    size_t grain = Heap_Grain(page, object);
+    page->live[grain / 64] |= UINT64_C(1) << (grain % 64);
+    return object;
+}
+
 static void mark_object(Allocator *allocator, Object *object) {
     if (object == NULL) return;
-    if (object->marked) return;
+
+    // Pair cells are marked through the first cell of their chunk.
+    if (object->type == OBJ_PAIR && object->cell > 0) {
+        object = (Object *)((char *)object - object->cell * PAIR_CELL_SIZE);
+    }
+
+    if (allocator_marked(object)) return;
 
 #ifdef DEBUG_TRACE_MEMORY
     printf("[Memory] %p get marked: ", object);
@@ -126,7 +311,7 @@ static void mark_object(Allocator *allocator, Object *object) {
     putchar('\n');
 #endif
 
-    object->marked = true;
+    allocator_set_marked(object, true);
 
     // Strings and native functions have no nested references, so no need
     // to push them into the gray stack
@@ -159,6 +344,28 @@ static void mark_array(Allocator *allocator, Value *values, size_t size) {
     }
 }
 
+static void mark_table(Allocator *allocator, Table *table) {
+    for (int i = 0; i <= table->hash_mask; i++) {
+        Entry *entry = &table->entries[i];
+
+        if (!Is_Nil(entry->key)) {
+            mark_value(allocator, entry->key);
+            mark_value(allocator, entry->value);
+        }
+    }
+}
+
+static void mark_dict(Allocator *allocator, Dict *dict) {
+    for (int i = 0; i < dict->used; i++) {
+        Entry *entry = &dict->entries[i];
+
+        if (!Is_Nil(entry->key)) {
+            mark_value(allocator, entry->key);
+            mark_value(allocator, entry->value);
+        }
+    }
+}
+
 void mark_roots(Allocator *allocator) {
     VM *vm = (VM *)allocator;
 
@@ -173,14 +380,10 @@ void mark_roots(Allocator *allocator) {
     }
 
     // Globals
-    for (int i = 0; i <= vm->globals.hash_mask; i++) {
-        Entry *entry = &vm->globals.entries[i];
+    mark_table(allocator, &vm->globals);
 
-        if (entry->key != NULL) {
-            mark_object(allocator, (Object *)entry->key);
-            mark_value(allocator, entry->value);
-        }
-    }
+    // Imported Modules
+    mark_table(allocator, &vm->modules);
 
     // Upvalues
     for (RavUpvalue *upvalue = vm->open_upvalues; upvalue != NULL; ) {
@@ -199,29 +402,26 @@ static void blacken_object(Allocator *allocator, Object *object) {
     switch (object->type) {
     case OBJ_PAIR: {
         RavPair *pair = (RavPair *)object;
+        for (; pair->header.cdr_next; pair = As_Pair(object_pair_tail(pair))) {
+            mark_value(allocator, pair->head);
+        }
         mark_value(allocator, pair->head);
         mark_value(allocator, pair->tail);
         break;
     }
 
     case OBJ_ARRAY: {
+        // packed arrays have no references
         RavArray *array = (RavArray *)object;
-        mark_array(allocator, array->values, array->count);
+        if (!array->packed) {
+            mark_array(allocator, array->values, array->count);
+        }
         break;
     }
 
     case OBJ_MAP: {
         RavMap *map = (RavMap *)object;
-
-        for (int i = 0; i <= map->table.hash_mask; i++) {
-            Entry *entry = &map->table.entries[i];
-
-            if (entry->key != NULL) {
-                mark_object(allocator, (Object *)entry->key);
-                mark_value(allocator, entry->value);
-            }
-        }
-
+        mark_dict(allocator, &map->dict);
         break;
     }
 
@@ -239,6 +439,15 @@ static void blacken_object(Allocator *allocator, Object *object) {
         mark_value(allocator, ((RavUpvalue *)object)->captured);
         break;
 
+    case OBJ_FILE:
+        mark_object(allocator, (Object *)((RavFile *)object)->path);
+        break;
+
+    case OBJ_SLICE:
+        mark_object(allocator, ((RavSlice *)object)->parent);
+        mark_object(allocator, (Object *)((RavSlice *)object)->string);
+        break;
+
     case OBJ_CLOSURE: {
         RavClosure *closure = (RavClosure *)object;
         mark_object(allocator, (Object *)closure->function);
@@ -263,17 +472,38 @@ static void trace_references(Allocator *allocator) {
 }
 
 static void sweep(Allocator *allocator) {
-    Object **link = &allocator->objects;
+    for (int i = 0; i < HEAP_CLASSES; i++) {
+        Page **link = &allocator->pages[i];
+        allocator->available[i] = NULL;
+
+        while (*link != NULL) {
+            Page *page = *link;
+            bool empty = true;
+
+            // The allocated but not marked objects are freed, and the
+            // marked ones are the allocated ones of the next round.
+            for (int j = 0; j < HEAP_PAGE_WORDS; j++) {
+                for (uint64_t dead = page->live[j] & ~page->marks[j]; dead != 0; dead &= dead - 1) {
+                    size_t grain = j * 64 + __builtin_ctzll(dead);
+                    free_object(allocator, page, (Object *)((char *)page + grain * HEAP_GRAIN));
+                }
+
+                page->live[j] = page->marks[j];
+                page->marks[j] = 0;
+                empty = empty && page->live[j] == 0;
+            }
 
-    while (*link != allocator->objects_end) {
-        if ((*link)->marked) {
-            (*link)->marked = false;
-            link = &(*link)->next;
-        } else {
-            Object *dead = *link;
-            *link = (*link)->next;
+            if (empty) {
+                *link = page->next;
+                munmap(page, HEAP_PAGE_SIZE);
+                continue;
+            }
 
-            free_object(allocator, dead);
+            if (page->free != NULL || page->bump != page->end) {
+                page->available = allocator->available[i];
+                allocator->available[i] = page;
+            }
+            link = &page->next;
         }
     }
 }
@@ -290,8 +520,10 @@ void allocator_gc(Allocator *allocator) {
     // Mark all reachable objects through the root objects.
     trace_references(allocator);
 
-    // Remove the weak references of the interned strings table.
+    // Remove the weak references of the interned strings and the
+    // hash-consed pairs tables.
     table_remove_weak(&allocator->strings);
+    table_remove_weak(&allocator->pairs);
 
     // Free the memory of the unreachable objects.
     sweep(allocator);
@@ -8,27 +8,60 @@
 // tri-color state of an object:
 // -----------------------------
 //   white -> not processed yet
-//            marked field is false
+//            mark bit is clear
 //
-//   gray  -> reachable, marked field is true
+//   gray  -> reachable, mark bit is set
 //            the gc didn't trace through its references yet
 //            present in the gray stack
 //
-//   black -> reachable, marked field is true
+//   black -> reachable, mark bit is set
 //            the gc traced through its references
 //            not present in the gray stack
 //
 
+// Read-only memory mapped file region, it's unmapped once it's released
+// by its loader, and all the objects referencing it are freed.
+typedef struct Region {
+    const void *start;
+    size_t size;
+    int references; // Referencing objects, plus one for the loader
+    struct Region *next;
+} Region;
+
+// Objects are allocated in the slots of heap pages, each page has slots of
+// one size class (a multiple of HEAP_GRAIN), and is aligned to its size,
+// so the page of an object is found by masking its address. The objects
+// have no links to each other, the sweep walks the pages bitmaps instead,
+// with a bit per grain, set at the first grain of each allocated object.
+#define HEAP_PAGE_SIZE   (64 * 1024)
+#define HEAP_GRAIN       8
+#define HEAP_OBJECT_MAX  256
+#define HEAP_CLASSES     (HEAP_OBJECT_MAX / HEAP_GRAIN)
+#define HEAP_PAGE_WORDS  (HEAP_PAGE_SIZE / HEAP_GRAIN / 64)
+
+typedef struct Page {
+    struct Page *next;      // Next page of the same size class
+    struct Page *available; // Next page with free slots of the same class
+    struct Slot *free;      // Swept slots, reused before the bump slots
+    char *bump;             // First never allocated slot
+    char *end;              // End of the last slot
+    size_t slot_size;
+    uint64_t live[HEAP_PAGE_WORDS];  // Allocated objects
+    uint64_t marks[HEAP_PAGE_WORDS]; // Marked objects (reachable)
+} Page;
+
 // Raven Objects Allocator
 typedef struct {
     // Table of all interned strings in a vm image.
     Table strings;
 
-    // Intrusive linked list of all allocated objects.
-    Object *objects;
+    // Table of all hash-consed pairs, by their heads and tails.
+    Table pairs;
 
-    // The end of `objects` list for the current context.
-    Object *objects_end;
+    // Pages of all allocated objects, and the pages with free slots,
+    // by size class.
+    Page *pages[HEAP_CLASSES];
+    Page *available[HEAP_CLASSES];
 
     // Array of currently marked, but not processed, objects.
     Object **gray_stack;
@@ -41,8 +74,20 @@ typedef struct {
 
     // Flag to disable the Garbage Collector.
     bool gc_off;
+
+    // Mapped file regions, objects may reference their memory
+    // (e.g. bytecode images), so they live as long as these objects.
+    Region *regions;
 } Allocator;
 
+// Growable characters buffer (see the string buffer API in 'object.h'),
+// its memory is accounted by the allocator, if there is one.
+typedef struct StringBuffer {
+    Allocator *allocator;
+    int count;
+    int capacity;
+    char *buffer;
+} StringBuffer;
 
 // The basic variant of the raven GC is as the amount of live objects
 // increases, the GC runs less avoiding wasting time re-traversing
@@ -79,6 +124,20 @@ void allocator_init(Allocator *allocator);
 // Free all the allocator used memory
 void allocator_free(Allocator *allocator);
 
+// Map the whole file at the given path as read-only memory, and set
+// `size` to its size. Return NULL on failure, with errno set to the
+// failure reason.
+const void *allocator_map(Allocator *allocator, const char *path, size_t *size);
+
+// Add a reference to the mapped region containing the given address,
+// from an object which is released when it's freed.
+void allocator_retain(Allocator *allocator, const void *pointer);
+
+// Drop a reference to the mapped region containing the given address,
+// or the loader reference given its start, and unmap the region if it
+// was the last one.
+void allocator_release(Allocator *allocator, const void *pointer);
+
 //
 // The main entry point for most of the runtime raven objects allocation
 // freeing and reallocation.
@@ -93,6 +152,38 @@ void allocator_free(Allocator *allocator);
 //
 void *allocate(Allocator *allocator, void *previous, size_t old_size, size_t new_size);
 
+// Allocate the memory of an object of the given size, at most
+// HEAP_OBJECT_MAX (checked for the object types in 'object.h'), which
+// is freed by the GC once it's unreachable. Exit if out of memory.
+Object *allocate_object(Allocator *allocator, size_t size);
+
+// The page of a heap object, and the index of its first grain.
+#define Heap_Page(object) \
+    ((Page *)((uintptr_t)(object) & ~(uintptr_t)(HEAP_PAGE_SIZE - 1)))
+#define Heap_Grain(page, object) \
+    ((size_t)((char *)(object) - (char *)(page)) / HEAP_GRAIN)
+
+// Set or clear the mark bit of the object, an object allocated while
+// its constructor allocates is marked so it's not freed by the GC.
+static inline void allocator_set_marked(Object *object, bool marked) {
+    Page *page = Heap_Page(object);
+    size_t grain = Heap_Grain(page, object);
+    uint64_t bit = UINT64_C(1) << (grain % 64);
+
+    if (marked) {
+        page->marks[grain / 64] |= bit;
+    } else {
+        page->marks[grain / 64] &= ~bit;
+    }
+}
+
+// Check if the object is marked, reachable in the current GC round.
+static inline bool allocator_marked(Object *object) {
+    Page *page = Heap_Page(object);
+    size_t grain = Heap_Grain(page, object);
+    return (page->marks[grain / 64] >> (grain % 64)) & 1;
+}
+
 // Start a GC round for the object allocated by given allocator, freeing
 // the memory of non-reachable objects
 void allocator_gc(Allocator *allocator);
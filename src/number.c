@@ -0,0 +1,576 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "number.h"
+#include "pow5.h"
+
+typedef __uint128_t uint128_t;
+
+static inline uint64_t double_bits(double number) {
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof bits);
+    return bits;
+}
+
+static inline double bits_double(uint64_t bits) {
+    double number;
+    memcpy(&number, &bits, sizeof number);
+    return number;
+}
+
+static inline uint128_t pow5_entry(int q) {
+    const uint64_t *entry = POW5_TABLE[q - POW5_MIN];
+    return (uint128_t)entry[0] << 64 | entry[1];
+}
+
+/// Formatting (Ryu)
+
+// See "Ryu: Fast Float-to-String Conversion" by Ulf Adams, the algorithm
+// below follows the reference implementation with 128-bit integers.
+
+#define POW5_INV_BITCOUNT 125
+#define POW5_BITCOUNT     125
+
+// Decimal significand and exponent, the number is `output * 10^exponent`.
+typedef struct {
+    uint64_t output;
+    int exponent;
+} Decimal;
+
+// ceil(log2(5^e)) for e in [0, 3528], (1 for e = 0).
+static inline int pow5_bits(int e) {
+    return ((e * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e)) for e in [0, 1650].
+static inline int log10_pow2(int e) {
+    return (e * 78913) >> 18;
+}
+
+// floor(log10(5^e)) for e in [0, 2620].
+static inline int log10_pow5(int e) {
+    return (e * 732923) >> 20;
+}
+
+static inline bool multiple_of_pow5(uint64_t value, int p) {
+    int count = 0;
+    while (value % 5 == 0) {
+        value /= 5;
+        count++;
+    }
+    return count >= p;
+}
+
+static inline bool multiple_of_pow2(uint64_t value, int p) {
+    return (value & ((1ull << p) - 1)) == 0;
+}
+
+// 5^i truncated to POW5_BITCOUNT bits.
+static inline uint128_t ryu_pow5(int i) {
+    return pow5_entry(i) >> 3;
+}
+
+// floor(2^(pow5_bits(q) - 1 + POW5_INV_BITCOUNT) / 5^q) + 1.
+static inline uint128_t ryu_pow5_inv(int q) {
+    if (q == 0) {
+        return ((uint128_t)1 << POW5_INV_BITCOUNT) + 1;
+    }
+    return (pow5_entry(-q) >> 3) + 1;
+}
+
+static inline uint64_t mul_shift(uint64_t m, uint128_t mul, int j) {
+    uint128_t low = (uint128_t)m * (uint64_t)mul;
+    uint128_t high = (uint128_t)m * (uint64_t)(mul >> 64);
+    return (uint64_t)(((low >> 64) + high) >> (j - 64));
+}
+
+// Shortest decimal in the rounding interval of a finite positive number.
+static Decimal shortest_decimal(uint64_t mantissa_bits, int exponent_bits) {
+    int e2;
+    uint64_t m2;
+
+    if (exponent_bits == 0) {
+        e2 = 1 - 1023 - 52 - 2;
+        m2 = mantissa_bits;
+    } else {
+        e2 = exponent_bits - 1023 - 52 - 2;
+        m2 = (1ull << 52) | mantissa_bits;
+    }
+
+    bool accept_bounds = (m2 & 1) == 0;
+
+    // Step 2: the interval of valid representations.
+    uint64_t mv = 4 * m2;
+    int mm_shift = mantissa_bits != 0 || exponent_bits <= 1;
+
+    // Step 3: the interval in decimal base.
+    uint64_t vr, vp, vm;
+    int e10;
+    bool vm_trailing_zeros = false;
+    bool vr_trailing_zeros = false;
+
+    if (e2 >= 0) {
+        int q = log10_pow2(e2) - (e2 > 3);
+        int k = POW5_INV_BITCOUNT + pow5_bits(q) - 1;
+        int i = -e2 + q + k;
+        uint128_t pow5 = ryu_pow5_inv(q);
+
+        e10 = q;
+        vr = mul_shift(4 * m2, pow5, i);
+        vp = mul_shift(4 * m2 + 2, pow5, i);
+        vm = mul_shift(4 * m2 - 1 - mm_shift, pow5, i);
+
+        if (q <= 21) {
+            // Only one of mp, mv, and mm can be a multiple of 5, if any.
+            if (mv % 5 == 0) {
+                vr_trailing_zeros = multiple_of_pow5(mv, q);
+            } else if (accept_bounds) {
+                vm_trailing_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+            } else {
+                vp -= multiple_of_pow5(mv + 2, q);
+            }
+        }
+    } else {
+        int q = log10_pow5(-e2) - (-e2 > 1);
+        int i = -e2 - q;
+        int k = pow5_bits(i) - POW5_BITCOUNT;
+        int j = q - k;
+        uint128_t pow5 = ryu_pow5(i);
+
+        e10 = q + e2;
+        vr = mul_shift(4 * m2, pow5, j);
+        vp = mul_shift(4 * m2 + 2, pow5, j);
+        vm = mul_shift(4 * m2 - 1 - mm_shift, pow5, j);
+
+        if (q <= 1) {
+            // mv has at least q trailing zero bits, since it's 4 * m2.
+            vr_trailing_zeros = true;
+            if (accept_bounds) {
+                vm_trailing_zeros = mm_shift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 63) {
+            vr_trailing_zeros = multiple_of_pow2(mv, q);
+        }
+    }
+
+    // Step 4: the shortest representation in the interval.
+    int removed = 0;
+    uint8_t last_removed = 0;
+    uint64_t output;
+
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        // The general (rare) case.
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+
+        if (vm_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+
+        // Round even if the exact number is .....50..0.
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) {
+            last_removed = 4;
+        }
+
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+    } else {
+        // The common case, where vm and vr have no trailing zeros.
+        bool round_up = false;
+
+        if (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+
+        while (vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+
+        output = vr + (vr == vm || round_up);
+    }
+
+    return (Decimal){ output, e10 + removed };
+}
+
+static inline int decimal_length(uint64_t number) {
+    int length = 1;
+    while (number >= 10) {
+        number /= 10;
+        length++;
+    }
+    return length;
+}
+
+static inline void write_digits(char *buffer, uint64_t number, int length) {
+    for (int i = length - 1; i >= 0; i--) {
+        buffer[i] = '0' + number % 10;
+        number /= 10;
+    }
+}
+
+int number_format(double number, char *buffer) {
+    uint64_t bits = double_bits(number);
+    bool sign = bits >> 63;
+    uint64_t mantissa_bits = bits & ((1ull << 52) - 1);
+    int exponent_bits = (bits >> 52) & 0x7FF;
+
+    char *cursor = buffer;
+
+    if (exponent_bits == 0x7FF) {
+        const char *special = mantissa_bits ? "nan" : sign ? "-inf" : "inf";
+        strcpy(buffer, special);
+        return strlen(special);
+    }
+
+    if (sign) {
+        *cursor++ = '-';
+    }
+
+    Decimal decimal;
+    if (exponent_bits == 0 && mantissa_bits == 0) {
+        decimal = (Decimal){ 0, 0 };
+    } else if (fabs(number) < 9007199254740992.0 && number == (double)(int64_t)number) {
+        // Integers are exact, strip their trailing zeros.
+        decimal = (Decimal){ (uint64_t)fabs(number), 0 };
+        while (decimal.output % 10 == 0) {
+            decimal.output /= 10;
+            decimal.exponent++;
+        }
+    } else {
+        decimal = shortest_decimal(mantissa_bits, exponent_bits);
+    }
+
+    // The number is 0.DIGITS * 10^point.
+    int length = decimal_length(decimal.output);
+    int point = length + decimal.exponent;
+
+    if (length <= point && point <= 21) {
+        // Integer: DIGITS000
+        write_digits(cursor, decimal.output, length);
+        memset(cursor + length, '0', point - length);
+        cursor += point;
+    } else if (0 < point && point <= 21) {
+        // Fraction: DIG.ITS
+        write_digits(cursor, decimal.output, length);
+        memmove(cursor + point + 1, cursor + point, length - point);
+        cursor[point] = '.';
+        cursor += length + 1;
+    } else if (-6 < point && point <= 0) {
+        // Small fraction: 0.000DIGITS
+        cursor[0] = '0';
+        cursor[1] = '.';
+        memset(cursor + 2, '0', -point);
+        write_digits(cursor + 2 - point, decimal.output, length);
+        cursor += 2 - point + length;
+    } else {
+        // Scientific: D.IGITSe+X
+        write_digits(cursor + 1, decimal.output, length);
+        cursor[0] = cursor[1];
+        if (length > 1) {
+            cursor[1] = '.';
+            cursor += length + 1;
+        } else {
+            cursor += 1;
+        }
+
+        int exponent = point - 1;
+        *cursor++ = 'e';
+        *cursor++ = exponent < 0 ? '-' : '+';
+        exponent = abs(exponent);
+
+        int exponent_length = decimal_length(exponent);
+        write_digits(cursor, exponent, exponent_length);
+        cursor += exponent_length;
+    }
+
+    *cursor = '\0';
+    return cursor - buffer;
+}
+
+/// Parsing (Clinger, Eisel-Lemire)
+
+// See "Number Parsing at a Gigabyte per Second" by Daniel Lemire, the
+// algorithm below follows the fast_float library.
+
+// Exact powers of ten as doubles.
+static const double POW10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Compute w * 10^q correctly rounded, return false if the result can't
+// be decided without more precision.
+static bool eisel_lemire(uint64_t w, int q, double *number) {
+    // w has at most 19 digits.
+    if (q < POW5_MIN) {
+        *number = 0.0;
+        return true;
+    }
+
+    if (q > 308) {
+        *number = INFINITY;
+        return true;
+    }
+
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+
+    // Small negative powers are rounded up, so exact halfway cases have
+    // no low bits in the product, and are caught by round to even below.
+    uint128_t pow5 = pow5_entry(q);
+    if (q < 0 && q >= -27) {
+        pow5++;
+    }
+
+    // The 128-bit truncated product of w and 5^q, the second half of
+    // the power is only needed if the lower bits may carry.
+    uint128_t product = (uint128_t)w * (uint64_t)(pow5 >> 64);
+    uint64_t high = (uint64_t)(product >> 64);
+    uint64_t low = (uint64_t)product;
+
+    if ((high & 0x1FF) == 0x1FF) {
+        uint64_t second = (uint64_t)(((uint128_t)w * (uint64_t)pow5) >> 64);
+        low += second;
+        if (second > low) {
+            high++;
+        }
+    }
+
+    if (low == UINT64_MAX && (q < -27 || q > 55)) {
+        return false;
+    }
+
+    int upper_bit = high >> 63;
+    uint64_t mantissa = high >> (upper_bit + 9);
+    int power2 = ((217706 * q) >> 16) + 63 + upper_bit - lz + 1023;
+
+    if (power2 <= 0) {
+        // Subnormal numbers.
+        if (-power2 + 1 >= 64) {
+            *number = 0.0;
+            return true;
+        }
+
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (1ull << 52) ? 0 : 1;
+
+        *number = bits_double(mantissa | (uint64_t)power2 << 52);
+        return true;
+    }
+
+    // Exactly halfway between two numbers, round to even.
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+        (mantissa << (upper_bit + 9)) == high) {
+        mantissa &= ~1ull;
+    }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+
+    if (mantissa >= (2ull << 52)) {
+        mantissa = 1ull << 52;
+        power2++;
+    }
+
+    mantissa &= ~(1ull << 52);
+
+    if (power2 >= 0x7FF) {
+        *number = INFINITY;
+        return true;
+    }
+
+    *number = bits_double(mantissa | (uint64_t)power2 << 52);
+    return true;
+}
+
+static bool parse_integer(const char *chars, int length, int base, double *number) {
+    if (length == 0) {
+        return false;
+    }
+
+    uint64_t integer = 0;
+    double overflow = 0.0;
+    bool overflowed = false;
+
+    for (int i = 0; i < length; i++) {
+        char c = chars[i];
+        int digit;
+
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+
+        if (digit >= base) {
+            return false;
+        }
+
+        // Beyond 64 bits, continue in floating point.
+        if (!overflowed && integer > (UINT64_MAX - digit) / base) {
+            overflowed = true;
+            overflow = (double)integer;
+        }
+
+        if (overflowed) {
+            overflow = overflow * base + digit;
+        } else {
+            integer = integer * base + digit;
+        }
+    }
+
+    *number = overflowed ? overflow : (double)integer;
+    return true;
+}
+
+// Parse with the C library, for the numbers the fast paths can't decide.
+static double parse_fallback(const char *chars, int length) {
+    char buffer[128];
+    char *copy = length < (int)sizeof buffer ? buffer : malloc(length + 1);
+
+    memcpy(copy, chars, length);
+    copy[length] = '\0';
+
+    double number = strtod(copy, NULL);
+
+    if (copy != buffer) {
+        free(copy);
+    }
+
+    return number;
+}
+
+bool number_parse(const char *chars, int length, double *number) {
+    if (length > 0 && (chars[0] == '-' || chars[0] == '+')) {
+        bool parsed = number_parse(chars + 1, length - 1, number);
+        if (chars[0] == '-') *number = -*number;
+        return parsed && length > 1 && chars[1] != '-' && chars[1] != '+';
+    }
+
+    if (length > 1 && chars[0] == '0') {
+        switch (chars[1]) {
+        case 'x': case 'X': return parse_integer(chars + 2, length - 2, 16, number);
+        case 'o': case 'O': return parse_integer(chars + 2, length - 2, 8, number);
+        case 'b': case 'B': return parse_integer(chars + 2, length - 2, 2, number);
+        }
+    }
+
+    const char *current = chars;
+    const char *end = chars + length;
+
+    // The significand w, with its first 19 significant digits.
+    uint64_t w = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool truncated = false;
+    bool any_digit = false;
+
+    for (; current < end && *current >= '0' && *current <= '9'; current++) {
+        any_digit = true;
+        if (digits < 19) {
+            w = w * 10 + (*current - '0');
+            digits += w != 0;
+        } else {
+            truncated |= *current != '0';
+            exponent++;
+        }
+    }
+
+    if (current < end && *current == '.') {
+        current++;
+
+        for (; current < end && *current >= '0' && *current <= '9'; current++) {
+            any_digit = true;
+            if (digits < 19) {
+                w = w * 10 + (*current - '0');
+                digits += w != 0;
+                exponent--;
+            } else {
+                truncated |= *current != '0';
+            }
+        }
+    }
+
+    if (!any_digit) {
+        return false;
+    }
+
+    if (current < end && (*current == 'e' || *current == 'E')) {
+        current++;
+
+        bool negative = false;
+        if (current < end && (*current == '+' || *current == '-')) {
+            negative = *current == '-';
+            current++;
+        }
+
+        if (current == end) {
+            return false;
+        }
+
+        int explicit = 0;
+        for (; current < end && *current >= '0' && *current <= '9'; current++) {
+            // Large exponents are out of range either way.
+            if (explicit < 100000) {
+                explicit = explicit * 10 + (*current - '0');
+            }
+        }
+
+        exponent += negative ? -explicit : explicit;
+    }
+
+    if (current != end) {
+        return false;
+    }
+
+    if (w == 0) {
+        *number = 0.0;
+        return true;
+    }
+
+    if (!truncated) {
+        // Clinger's fast path, both w and 10^|exponent| are exact doubles.
+        if (w <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+            *number = exponent < 0 ? w / POW10[-exponent] : w * POW10[exponent];
+            return true;
+        }
+
+        if (eisel_lemire(w, exponent, number)) {
+            return true;
+        }
+    }
+
+    *number = parse_fallback(chars, length);
+    return true;
+}
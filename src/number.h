@@ -0,0 +1,30 @@
+#ifndef raven_number_h
+#define raven_number_h
+
+// Number Conversions
+//
+// Locale independent conversions between numbers and their textual
+// representation. Numbers are formatted in the shortest form that parses
+// back to the same number (Ryu), and parsed exactly with the fast path
+// of Clinger and the algorithm of Eisel-Lemire, falling back to `strtod`
+// in the rare ambiguous cases.
+
+#include "common.h"
+
+// Size of a buffer large enough for any formatted number,
+// including the null terminator.
+#define NUMBER_BUFFER_SIZE 32
+
+// Write the shortest representation of the number that parses back to
+// it into the buffer, null-terminated, and return its length. Numbers
+// in the range [1e-6, 1e21) are written in decimal notation, and the
+// rest in scientific notation (e.g. 1e+21).
+int number_format(double number, char *buffer);
+
+// Parse a number of the given length, in decimal notation with an
+// optional sign, fraction and exponent, or in hexadecimal, octal or binary
+// notation with the '0x', '0o' or '0b' prefixes. Return false if the
+// number is malformed.
+bool number_parse(const char *chars, int length, double *number);
+
+#endif
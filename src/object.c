@@ -1,11 +1,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "chunk.h"
 #include "table.h"
 #include "mem.h"
+#include "number.h"
 #include "object.h"
 #include "value.h"
 #include "vm.h"
@@ -16,16 +18,15 @@
                                 sizeof (struct_type))
 
 static Object *alloc_object(Allocator *allocator, ObjectType type, size_t size) {
-    Object *object = (Object *)allocate(allocator, NULL, 0, size);
+    Object *object = allocate_object(allocator, size);
     object->type = type;
-    object->marked = false;
-    object->next = allocator->objects;
+    object->cell = 0;
+    object->cdr_next = false;
 
 #ifdef DEBUG_TRACE_MEMORY
     printf("[Memory] %p : allocate %ld for %d\n", object, size, type);
 #endif
 
-    allocator->objects = object;
     return object;
 }
 
@@ -34,8 +35,9 @@ static RavString *construct_string(Allocator *allocator, int length, uint32_t ha
     string->length = length;
     string->hash = hash;
     string->chars = chars;
+    string->borrowed = false;
 
-    table_set(&allocator->strings, string, Nil_Value);
+    table_set(&allocator->strings, Obj_Value(string), Nil_Value);
     return string;
 }
 
@@ -81,6 +83,18 @@ RavString *object_string_box(Allocator *allocator, char *chars, int length) {
     return construct_string(allocator, length, hash, chars);
 }
 
+RavString *object_string_borrow(Allocator *allocator, const char *chars, int length, uint32_t hash) {
+    RavString *interned = table_interned(&allocator->strings, chars, hash, length);
+    if (interned != NULL) {
+        return interned;
+    }
+
+    RavString *string = construct_string(allocator, length, hash, (char *)chars);
+    string->borrowed = true;
+    allocator_retain(allocator, chars);
+    return string;
+}
+
 RavPair *object_pair(Allocator *allocator, Value head, Value tail) {
     RavPair *pair = Alloc_Object(allocator, RavPair, OBJ_PAIR);
 
@@ -90,23 +104,154 @@ RavPair *object_pair(Allocator *allocator, Value head, Value tail) {
     return pair;
 }
 
+void object_list(Allocator *allocator, Value *values, size_t count) {
+    Value *list = &values[count];
+
+    // Build the chunks backward, each one is kept reachable as the
+    // tail of the next, until the first one replaces the tail.
+    while (count > 0) {
+        size_t cells = count < PAIR_CHUNK_MAX ? count : PAIR_CHUNK_MAX;
+        size_t size = (cells - 1) * PAIR_CELL_SIZE + sizeof (RavPair);
+        char *chunk = (char *)alloc_object(allocator, OBJ_PAIR, size);
+        Value *heads = &values[count - cells];
+
+        for (size_t i = 0; i < cells; i++) {
+            RavPair *pair = (RavPair *)(chunk + i * PAIR_CELL_SIZE);
+            pair->header.type = OBJ_PAIR;
+            pair->header.cell = (uint8_t)i;
+            pair->header.cdr_next = i + 1 < cells;
+            pair->head = heads[i];
+        }
+
+        ((RavPair *)(chunk + (cells - 1) * PAIR_CELL_SIZE))->tail = *list;
+        *list = Obj_Value((Object *)chunk);
+        count -= cells;
+    }
+}
+
+RavPair *object_pair_consed(Allocator *allocator, Value head, Value tail) {
+    RavPair *consed = table_consed(&allocator->pairs, head, tail);
+    if (consed != NULL) {
+        return consed;
+    }
+
+    RavPair *pair = object_pair(allocator, head, tail);
+    table_set(&allocator->pairs, Obj_Value(pair), Nil_Value);
+    return pair;
+}
+
 RavArray *object_array(Allocator *allocator, Value *values, size_t count) {
     RavArray *array = Alloc_Object(allocator, RavArray, OBJ_ARRAY);
 
-    array->header.marked = true; // for gc
-    array->values = Alloc(allocator, Value, count);
-    array->header.marked = false;
+    bool packed = true;
+    for (size_t i = 0; i < count && packed; i++) {
+        packed = Is_Num(values[i]);
+    }
+
+    allocator_set_marked(&array->header, true); // for gc
+    array->packed = packed;
+    array->count = 0;
+    array->capacity = count;
+    if (packed) {
+        array->numbers = Alloc(allocator, double, count);
+        for (size_t i = 0; i < count; i++) {
+            array->numbers[i] = As_Num(values[i]);
+        }
+    } else {
+        array->values = Alloc(allocator, Value, count);
+        memcpy(array->values, values, count * sizeof (Value));
+    }
+    allocator_set_marked(&array->header, false);
     array->count = count;
+
+    return array;
+}
+
+RavArray *object_array_packed(Allocator *allocator, size_t count) {
+    RavArray *array = Alloc_Object(allocator, RavArray, OBJ_ARRAY);
+
+    allocator_set_marked(&array->header, true); // for gc
+    array->packed = true;
+    array->count = 0;
     array->capacity = count;
+    array->numbers = Alloc(allocator, double, count);
+    allocator_set_marked(&array->header, false);
+    array->count = count;
 
-    memcpy(array->values, values, count * sizeof (Value));
+    return array;
+}
 
+RavArray *object_array_empty(Allocator *allocator, size_t capacity) {
+    RavArray *array = object_array_packed(allocator, capacity);
+    array->count = 0;
     return array;
 }
 
+bool object_array_pack(Allocator *allocator, RavArray *array, size_t *index) {
+    if (array->packed) {
+        return true;
+    }
+
+    for (size_t i = 0; i < array->count; i++) {
+        if (!Is_Num(array->values[i])) {
+            *index = i;
+            return false;
+        }
+    }
+
+    double *numbers = Alloc(allocator, double, array->capacity);
+    for (size_t i = 0; i < array->count; i++) {
+        numbers[i] = As_Num(array->values[i]);
+    }
+
+    Free_Array(allocator, Value, array->values, array->capacity);
+    array->numbers = numbers;
+    array->packed = true;
+    return true;
+}
+
+void object_array_unpack(Allocator *allocator, RavArray *array) {
+    assert(array->packed);
+
+    // the elements are numbers, so the array can be traced while it's
+    // still packed, if a GC round is triggered by the allocation
+    Value *values = Alloc(allocator, Value, array->capacity);
+    for (size_t i = 0; i < array->count; i++) {
+        values[i] = Num_Value(array->numbers[i]);
+    }
+
+    Free_Array(allocator, double, array->numbers, array->capacity);
+    array->values = values;
+    array->packed = false;
+}
+
+void object_array_push(Allocator *allocator, RavArray *array, Value value) {
+    if (array->packed && !Is_Num(value)) {
+        object_array_unpack(allocator, array);
+    }
+
+    if (array->count == array->capacity) {
+        size_t old_capacity = array->capacity;
+        size_t new_capacity = Grow_Capacity(old_capacity);
+
+        if (array->packed) {
+            array->numbers = Grow_Array(allocator, array->numbers, double, old_capacity, new_capacity);
+        } else {
+            array->values = Grow_Array(allocator, array->values, Value, old_capacity, new_capacity);
+        }
+        array->capacity = new_capacity;
+    }
+
+    if (array->packed) {
+        array->numbers[array->count++] = As_Num(value);
+    } else {
+        array->values[array->count++] = value;
+    }
+}
+
 RavMap *object_map(Allocator *allocator) {
     RavMap *map = Alloc_Object(allocator, RavMap, OBJ_MAP);
-    table_init(&map->table);
+    dict_init(&map->dict);
     return map;
 }
 
@@ -116,6 +261,7 @@ RavFunction *object_function(Allocator *allocator) {
     function->name = NULL;
     function->arity = 0;
     function->upvalue_count = 0;
+    function->max_slots = 0;
 
     chunk_init(&function->chunk);
     return function;
@@ -154,200 +300,270 @@ RavCFunction *object_cfunction(Allocator *allocator, CFunc func, int arity_min,
     return cfunction;
 }
 
-static void print_pair(RavPair *pair) {
-    value_print(pair->head);
+RavFile *object_file(Allocator *allocator, RavString *path) {
+    RavFile *file = Alloc_Object(allocator, RavFile, OBJ_FILE);
+    file->path = path;
+    file->fd = -1;
+    file->mapped = false;
+    file->eof = false;
+    file->closed = true;
+    file->data = NULL;
+    file->size = 0;
+    file->capacity = 0;
+    file->offset = 0;
+    return file;
+}
 
-    // end of a proper list?
-    if (Is_Nil(pair->tail)) {
-        return;
+void object_file_close(RavFile *file) {
+    if (!file->mapped) {
+        free(file->data);
+        file->data = NULL;
+        file->size = file->capacity = 0;
     }
 
-    if (Is_Pair(pair->tail)) {
-        printf(", ");
-        print_pair(As_Pair(pair->tail));
-    } else {
-        printf(" . ");
-        value_print(pair->tail);
+    if (file->fd != -1) {
+        close(file->fd);
     }
+
+    file->fd = -1;
+    file->closed = true;
+    file->offset = 0;
 }
 
-// TODO: handling cyclic references
+RavSlice *object_slice(Allocator *allocator, Object *parent, const char *chars, int length) {
+    if (parent->type == OBJ_SLICE) {
+        parent = ((RavSlice *)parent)->parent;
+    }
 
-static void print_array(RavArray *array) {
-    putchar('[');
+    RavSlice *slice = Alloc_Object(allocator, RavSlice, OBJ_SLICE);
+    slice->parent = parent;
+    slice->chars = chars;
+    slice->length = length;
+    slice->string = NULL;
+    return slice;
+}
 
-    for (int i = 0; i < (int)array->count - 1; i++) {
-        value_print(array->values[i]);
-        printf(", ");
+RavString *object_slice_intern(Allocator *allocator, RavSlice *slice) {
+    if (slice->string == NULL) {
+        slice->string = object_string(allocator, slice->chars, slice->length);
     }
+    return slice->string;
+}
 
-    if (array->count > 0) {
-        value_print(array->values[array->count - 1]);
+RavString *object_slice_interned(Allocator *allocator, RavSlice *slice) {
+    if (slice->string == NULL) {
+        uint32_t hash = hash_string(slice->chars, slice->length);
+        slice->string = table_interned(&allocator->strings, slice->chars, hash, slice->length);
     }
+    return slice->string;
+}
+
+/// String Buffer API
 
-    putchar(']');
+StringBuffer string_buf_new(Allocator *allocator) {
+    StringBuffer self = {};
+    self.allocator = allocator;
+    return self;
 }
 
-static void print_map(RavMap *map) {
-    putchar('{');
+void string_buf_free(StringBuffer *self) {
+    if (self->buffer) {
+        if (self->allocator) {
+            Free_Array(self->allocator, char, self->buffer, self->capacity);
+        } else {
+            free(self->buffer);
+        }
+    }
+    *self = (StringBuffer){0};
+}
 
-    Entry *entries = map->table.entries;
-    int last_index = map->table.hash_mask;
+static void buffer_reserve(StringBuffer *self, size_t capacity) {
+    if (self->allocator) {
+        self->buffer = allocate(self->allocator, self->buffer, self->capacity, capacity);
+    } else {
+        self->buffer = realloc(self->buffer, capacity);
+    }
+    self->capacity = capacity;
+}
 
-    for (int i = 0; i < last_index; i++) {
-        if (entries[i].key == NULL) {
-            continue;
+void string_buf_write(StringBuffer *self, const char *chars, int length) {
+    if (self->count + length > self->capacity) {
+        size_t new_capacity = Grow_Capacity(self->capacity);
+        if (new_capacity <= (size_t)(self->count + length)) {
+            new_capacity += (size_t)length;
         }
 
-        object_print(Obj_Value(entries[i].key));
-        printf(": ");
-        value_print(entries[i].value);
-        printf(", ");
+        buffer_reserve(self, new_capacity);
     }
 
-    if (last_index >= 0) {
-        object_print(Obj_Value(entries[last_index].key));
-        printf(": ");
-        value_print(entries[last_index].value);
+    if (length > 0) {
+        memcpy(self->buffer + self->count, chars, length);
+        self->count += length;
     }
+}
 
-    putchar('}');
+static inline void buffer_write_cstring(StringBuffer *self, const char *chars) {
+    string_buf_write(self, chars, strlen(chars));
 }
 
-static void print_function(RavFunction *function) {
-    if (function->name == NULL) {
-        printf("<top-level>");
-        return;
+static void push_pair(StringBuffer *self, RavPair *pair) {
+    string_buf_write(self, "(", 1);
+
+    for (;;) {
+        string_buf_push(self, pair->head);
+
+        Value tail = object_pair_tail(pair);
+
+        // end of a proper list?
+        if (Is_Nil(tail)) {
+            break;
+        }
+
+        if (Is_Pair(tail)) {
+            string_buf_write(self, ", ", 2);
+            pair = As_Pair(tail);
+        } else {
+            string_buf_write(self, " . ", 3);
+            string_buf_push(self, tail);
+            break;
+        }
     }
 
-    printf("<fn %s>", function->name->chars);
+    string_buf_write(self, ")", 1);
 }
 
-void object_print(Value value) {
-    switch (Obj_Type(value)) {
-    case OBJ_STRING: {
-        RavString *string = As_String(value);
-        printf("%.*s", string->length, string->chars);
-        break;
-    }
-    case OBJ_PAIR: {
-        putchar('(');
-        print_pair(As_Pair(value));
-        putchar(')');
-        break;
-    }
-    case OBJ_ARRAY: {
-        print_array(As_Array(value));
-        break;
-    }
-    case OBJ_MAP: {
-        print_map(As_Map(value));
-        break;
-    }
-    case OBJ_FUNCTION: {
-        print_function(As_Function(value));
-        break;
-    }
-    case OBJ_UPVALUE: {
-        printf("<upvalue>");
-        break;
-    }
-    case OBJ_CLOSURE: {
-        print_function(As_Closure(value)->function);
-        break;
-    }
-    case OBJ_CFUNCTION: {
-        printf("<native @ %p>", As_CFunction(value)->func);
-        break;
-    }
-    default:
-        assert(!"invalid object type");
+// TODO: handling cyclic references
+
+static void push_array(StringBuffer *self, RavArray *array) {
+    string_buf_write(self, "[", 1);
+
+    for (size_t i = 0; i < array->count; i++) {
+        if (i > 0) {
+            string_buf_write(self, ", ", 2);
+        }
+        string_buf_push(self, object_array_get(array, i));
     }
+
+    string_buf_write(self, "]", 1);
 }
 
-/// String Buffer API
+static void push_map(StringBuffer *self, RavMap *map) {
+    string_buf_write(self, "{", 1);
 
-StringBuffer string_buf_new(Allocator *allocator) {
-    StringBuffer self = {};
-    self.allocator = allocator;
-    return self;
+    bool first = true;
+    for (int i = 0; i < map->dict.used; i++) {
+        Entry *entry = &map->dict.entries[i];
+        if (Is_Nil(entry->key)) {
+            continue;
+        }
+
+        if (!first) {
+            string_buf_write(self, ", ", 2);
+        }
+        first = false;
+
+        string_buf_push(self, entry->key);
+        string_buf_write(self, ": ", 2);
+        string_buf_push(self, entry->value);
+    }
+
+    string_buf_write(self, "}", 1);
 }
 
-void string_buf_free(StringBuffer *self) {
-    if (self->buffer) {
-        Free_Array(self->allocator, char, self->buffer, self->capacity);
+static void push_function(StringBuffer *self, RavFunction *function) {
+    if (function->name == NULL) {
+        buffer_write_cstring(self, "<top-level>");
+        return;
     }
-    *self = (StringBuffer){0};
+
+    buffer_write_cstring(self, "<fn ");
+    string_buf_write(self, function->name->chars, function->name->length);
+    buffer_write_cstring(self, ">");
 }
 
 void string_buf_push(StringBuffer *self, Value value) {
-    const char *value_string = NULL;
-    int value_length = 0;
-    char buffer[128] = {0};
-
     if (Is_Nil(value)) {
-        value_string = "nil";
-        value_length = strlen(value_string);
+        buffer_write_cstring(self, "nil");
     } else if (Is_Bool(value)) {
-        value_string = As_Bool(value) ? "true" : "false";
-        value_length = strlen(value_string);
+        buffer_write_cstring(self, As_Bool(value) ? "true" : "false");
     } else if (Is_Num(value)) {
-        int written = snprintf(buffer, sizeof buffer, "%g", As_Num(value));
-        assert(written > 0);
-        value_string = buffer;
-        value_length = written;
-    } else if (Is_String(value)) {
-        RavString *string = As_String(value);
-        value_string = string->chars;
-        value_length = string->length;
-    } else if (Is_Pair(value)) {
-        // TODO
-        value_string = "<pair>";
-        value_length = strlen(value_string);
-    } else if (Is_Array(value)) {
-        // TODO
-        value_string = "<array>";
-        value_length = strlen(value_string);
-    } else if (Is_Map(value)) {
-        // TODO
-        value_string = "<map>";
-        value_length = strlen(value_string);
-    } else if (Is_Function(value)) {
-        int written = snprintf(buffer, sizeof buffer, "<fn %s>", As_Function(value)->name->chars);
-        assert(written > 0);
-        value_string = buffer;
-        value_length = written;
-    } else if (Is_Closure(value)) {
-        int written = snprintf(buffer, sizeof buffer, "<closure %p>", As_Closure(value));
-        assert(written > 0);
-        value_string = buffer;
-        value_length = written;
-    } else if (Is_CFunction(value)) {
-        int written = snprintf(buffer, sizeof buffer, "<native @ %p>", As_Obj(value));
-        assert(written > 0);
-        value_string = buffer;
-        value_length = written;
+        char buffer[NUMBER_BUFFER_SIZE];
+        int length = number_format(As_Num(value), buffer);
+        string_buf_write(self, buffer, length);
     } else {
-        assert(!"unreachable: invalid value tag");
+        switch (Obj_Type(value)) {
+        case OBJ_STRING: {
+            RavString *string = As_String(value);
+            string_buf_write(self, string->chars, string->length);
+            break;
+        }
+        case OBJ_PAIR:
+            push_pair(self, As_Pair(value));
+            break;
+        case OBJ_ARRAY:
+            push_array(self, As_Array(value));
+            break;
+        case OBJ_MAP:
+            push_map(self, As_Map(value));
+            break;
+        case OBJ_FUNCTION:
+            push_function(self, As_Function(value));
+            break;
+        case OBJ_UPVALUE:
+            buffer_write_cstring(self, "<upvalue>");
+            break;
+        case OBJ_CLOSURE:
+            push_function(self, As_Closure(value)->function);
+            break;
+        case OBJ_CFUNCTION: {
+            char buffer[64];
+            int length = snprintf(buffer, sizeof buffer, "<native @ %p>", (void *)As_CFunction(value)->func);
+            string_buf_write(self, buffer, length);
+            break;
+        }
+        case OBJ_SLICE: {
+            RavSlice *slice = As_Slice(value);
+            string_buf_write(self, slice->chars, slice->length);
+            break;
+        }
+        case OBJ_FILE: {
+            RavString *path = As_File(value)->path;
+            buffer_write_cstring(self, "<file ");
+            string_buf_write(self, path->chars, path->length);
+            buffer_write_cstring(self, ">");
+            break;
+        }
+        default:
+            assert(!"invalid object type");
+        }
     }
+}
 
-    if (self->count + value_length > self->capacity) {
-        size_t new_capacity = Grow_Capacity(self->capacity);
-        if (new_capacity <= (size_t)(self->count + value_length)) {
-            new_capacity += (size_t)value_length;
-        }
+void string_buf_push_values(StringBuffer *self, Value *values, int count) {
+    // exact for strings, a guess for the rest of values
+    size_t estimate = self->count + 1;
+    for (int i = 0; i < count; i++) {
+        int length = 16;
+        if (Is_Text(values[i])) object_text(values[i], &length);
+        estimate += length;
+    }
 
-        self->buffer = allocate(self->allocator, self->buffer, self->capacity, new_capacity);
-        self->capacity = new_capacity;
+    if (estimate > (size_t)self->capacity) {
+        buffer_reserve(self, estimate);
     }
 
-    memcpy(self->buffer + self->count, value_string, value_length);
-    self->count += value_length;
+    for (int i = 0; i < count; i++) {
+        string_buf_push(self, values[i]);
+    }
 }
 
 RavString *string_buf_into(StringBuffer *self) {
+    assert(self->allocator != NULL);
+
     // shrink the string buffer into the string needed length
-    self->buffer = allocate(self->allocator, self->buffer, self->capacity, self->count + 1);
+    if (self->capacity != self->count + 1) {
+        self->buffer = allocate(self->allocator, self->buffer, self->capacity, self->count + 1);
+    }
     self->buffer[self->count] = '\0';
 
     // allocate a string object pointing to the buffer string
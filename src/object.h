@@ -10,6 +10,9 @@
 #include "value.h"
 #include "vm.h"
 
+// Native functions get their arguments and count, and set the result,
+// they return false on runtime errors, and may call back into the vm
+// with `vm_call`.
 typedef bool (*CFunc)(VM*, Value*, size_t, Value*);
 
 typedef enum {
@@ -21,14 +24,16 @@ typedef enum {
     OBJ_UPVALUE,
     OBJ_CLOSURE,
     OBJ_CFUNCTION,
+    OBJ_FILE,
+    OBJ_SLICE,
 } ObjectType;
 
-// The header (metadata) of all objects.
-// TODO: consider using pointer tagging.
+// The header (metadata) of all objects, the objects are linked by their
+// heap pages, and marked in their bitmaps (see 'mem.h').
 struct Object {
     ObjectType type;
-    bool marked;
-    struct Object *next;
+    uint8_t cell;  // Index of the pair cell in its list chunk
+    bool cdr_next; // The tail of the pair cell is the next cell
 };
 
 struct RavString {
@@ -36,24 +41,42 @@ struct RavString {
     int length;
     uint32_t hash;
     char *chars;
+    bool borrowed; // The chars memory is not owned (e.g. a mapped image).
 };
 
+// Lists built at once are allocated in chunks of consecutive pair cells,
+// where the tail of each cell, but the last one, is the next cell, which
+// is implied rather than stored (CDR-coding). A chunk is a single heap
+// object, marked and freed as a whole through its first cell, the other
+// cells find it by their index.
 struct RavPair {
     Object header;
     Value head;
-    Value tail;
+    Value tail; // Only stored if the tail isn't the next cell
 };
 
+// Size of the pair cells whose tail is the next cell.
+#define PAIR_CELL_SIZE offsetof(RavPair, tail)
+
+// Maximum number of pair cells in a list chunk, the largest heap object.
+#define PAIR_CHUNK_MAX ((HEAP_OBJECT_MAX - sizeof (RavPair)) / PAIR_CELL_SIZE + 1)
+
+// Arrays of numbers only are packed, their elements are stored unboxed
+// and aren't traced by the GC, until a non-number element is stored.
 struct RavArray {
     Object header;
-    Value *values;
+    union {
+        Value *values;   // Elements of generic arrays
+        double *numbers; // Elements of packed arrays
+    };
     size_t count;
     size_t capacity;
+    bool packed;
 };
 
 struct RavMap {
     Object header;
-    Table table;
+    Dict dict;
 };
 
 struct RavFunction {
@@ -61,6 +84,7 @@ struct RavFunction {
     RavString *name;
     int arity;
     int upvalue_count;
+    int max_slots; // Maximum number of stack slots used by locals.
     Chunk chunk;
 };
 
@@ -89,6 +113,50 @@ struct RavCFunction {
     int arity_max;
 };
 
+// An opened file, regular files are mapped into memory and read in
+// place, other files (e.g. pipes) are read through a sliding buffer.
+struct RavFile {
+    Object header;
+    RavString *path;
+    int fd;          // -1 if not needed (mapped) or closed
+    bool mapped;
+    bool eof;        // The end of a buffered file was read
+    bool closed;
+    char *data;      // Mapped file contents, or buffered contents
+    size_t size;     // Mapped size, or count of buffered bytes
+    size_t capacity; // Buffer capacity
+    size_t offset;   // Current read position in data
+};
+
+// A view of a sequence of characters owned by another object, a string
+// or a mapped file, which is kept alive by the view. Slices are strings
+// for the language, they are compared with strings by their characters,
+// and interned only when they are used as map keys.
+struct RavSlice {
+    Object header;
+    Object *parent;    // String or file owning the characters
+    const char *chars; // Not null-terminated
+    int length;
+    RavString *string; // The interned string, once materialized
+};
+
+// Every object type must fit in the slots of heap pages.
+#define Check_Object_Size(type) \
+    _Static_assert(sizeof (type) <= HEAP_OBJECT_MAX, #type " is larger than HEAP_OBJECT_MAX")
+
+Check_Object_Size(RavString);
+Check_Object_Size(RavPair);
+Check_Object_Size(RavArray);
+Check_Object_Size(RavMap);
+Check_Object_Size(RavFunction);
+Check_Object_Size(RavUpvalue);
+Check_Object_Size(RavClosure);
+Check_Object_Size(RavCFunction);
+Check_Object_Size(RavFile);
+Check_Object_Size(RavSlice);
+
+#undef Check_Object_Size
+
 #define Obj_Type(value) (As_Obj(value)->type)
 
 #define Is_String(value)    object_type_is(value, OBJ_STRING)
@@ -98,6 +166,9 @@ struct RavCFunction {
 #define Is_Function(value)  object_type_is(value, OBJ_FUNCTION)
 #define Is_Closure(value)   object_type_is(value, OBJ_CLOSURE)
 #define Is_CFunction(value) object_type_is(value, OBJ_CFUNCTION)
+#define Is_File(value)      object_type_is(value, OBJ_FILE)
+#define Is_Slice(value)     object_type_is(value, OBJ_SLICE)
+#define Is_Text(value)      (Is_String(value) || Is_Slice(value))
 
 #define As_String(value)    ((RavString *)As_Obj(value))
 #define As_Pair(value)      ((RavPair *)As_Obj(value))
@@ -107,6 +178,8 @@ struct RavCFunction {
 #define As_Function(value)  ((RavFunction *)As_Obj(value))
 #define As_Closure(value)   ((RavClosure *)As_Obj(value))
 #define As_CFunction(value) ((RavCFunction *)As_Obj(value))
+#define As_File(value)      ((RavFile *)As_Obj(value))
+#define As_Slice(value)     ((RavSlice *)As_Obj(value))
 
 /// Object API
 
@@ -117,12 +190,45 @@ RavString *object_string(Allocator *allocator, const char *chars, int length);
 // The object will have an ownership of the chars memory.
 RavString *object_string_box(Allocator *allocator, char *chars, int length);
 
+// Construct a RavString referencing the given null-terminated string,
+// with a precomputed hash. The object doesn't own the chars memory,
+// which must be in a region mapped by the allocator, it keeps the
+// region mapped.
+RavString *object_string_borrow(Allocator *allocator, const char *chars, int length, uint32_t hash);
+
 // Construct a RavPair with the given head and tail.
 RavPair *object_pair(Allocator *allocator, Value head, Value tail);
 
-// Construct a RavArray from the provided sized array.
+// Construct a list of the `count` heads in `values`, followed by its tail
+// in `values[count]`, which is replaced by the list, the values must be
+// reachable by the GC.
+void object_list(Allocator *allocator, Value *values, size_t count);
+
+// Return the hash-consed RavPair with the given head and tail, which is
+// constructed once, and shared while it's reachable. Heads and tails are
+// compared by identity, and numbers by their bits.
+RavPair *object_pair_consed(Allocator *allocator, Value head, Value tail);
+
+// Construct a RavArray from the provided sized array, packed if all
+// the values are numbers (or there are no values).
 RavArray *object_array(Allocator *allocator, Value *array, size_t count);
 
+// Construct a packed RavArray of `count` numbers, left uninitialized.
+RavArray *object_array_packed(Allocator *allocator, size_t count);
+
+// Construct an empty RavArray with room for `capacity` elements.
+RavArray *object_array_empty(Allocator *allocator, size_t capacity);
+
+// Convert a generic array holding only numbers into a packed one, return
+// false and set `index` to the first element which isn't a number otherwise.
+bool object_array_pack(Allocator *allocator, RavArray *array, size_t *index);
+
+// Convert a packed array into a generic one.
+void object_array_unpack(Allocator *allocator, RavArray *array);
+
+// Append a value to the array, the value must be reachable by the GC.
+void object_array_push(Allocator *allocator, RavArray *array, Value value);
+
 // Construct an empty RavMap.
 RavMap *object_map(Allocator *allocator);
 
@@ -138,32 +244,89 @@ RavClosure *object_closure(Allocator *allocator, RavFunction *function);
 // Construct a C function object.
 RavCFunction *object_cfunction(Allocator *allocator, CFunc func, int arity_min, int arity_max);
 
-// Pretty print a raven object to the standard output.
-void object_print(Value value);
+// Construct a closed file object, with the given path.
+RavFile *object_file(Allocator *allocator, RavString *path);
+
+// Release the file descriptor and buffer of a file object. The contents
+// of a mapped file are unmapped only when the object is freed, since
+// they may still be referenced by slices.
+void object_file_close(RavFile *file);
+
+// Construct a slice of the given characters owned by the parent object,
+// a string, a mapped file, or another slice (its parent is used then).
+RavSlice *object_slice(Allocator *allocator, Object *parent, const char *chars, int length);
+
+// Return the interned string of the slice characters, constructing it
+// if there is no such string.
+RavString *object_slice_intern(Allocator *allocator, RavSlice *slice);
+
+// Return the interned string of the slice characters if it exists,
+// otherwise return NULL, without allocating.
+RavString *object_slice_interned(Allocator *allocator, RavSlice *slice);
 
 // Check if a given raven value is an object with specified type.
 static inline bool object_type_is(Value value, ObjectType type) {
     return Is_Obj(value) && Obj_Type(value) == type;
 }
 
-/// Object Utilites
+// Return the tail of the pair, the next cell of CDR-coded pairs.
+static inline Value object_pair_tail(RavPair *pair) {
+    if (pair->header.cdr_next) {
+        return Obj_Value((Object *)((char *)pair + PAIR_CELL_SIZE));
+    }
+    return pair->tail;
+}
+
+// Return the element of the array at the given index.
+static inline Value object_array_get(RavArray *array, size_t index) {
+    return array->packed ? Num_Value(array->numbers[index]) : array->values[index];
+}
+
+// Set the element of the array at the given index, a packed array is
+// unpacked if the value isn't a number, so it must be reachable by the GC.
+static inline void object_array_set(Allocator *allocator, RavArray *array, size_t index, Value value) {
+    if (array->packed) {
+        if (Is_Num(value)) {
+            array->numbers[index] = As_Num(value);
+            return;
+        }
+        object_array_unpack(allocator, array);
+    }
+    array->values[index] = value;
+}
 
-typedef struct StringBuffer {
-    Allocator *allocator;
-    int count;
-    int capacity;
-    char *buffer;
-} StringBuffer;
+// Return the characters of a string or a slice value, and set `length`
+// to its length, the characters of slices are not null-terminated.
+static inline const char *object_text(Value value, int *length) {
+    if (Is_String(value)) {
+        *length = As_String(value)->length;
+        return As_String(value)->chars;
+    }
+
+    *length = As_Slice(value)->length;
+    return As_Slice(value)->chars;
+}
 
-// Constructs a new string buffer
+/// Object Utilites
+
+// Constructs a new string buffer, without an allocator its memory
+// is not accounted by the GC, and it can't be converted into a string
 StringBuffer string_buf_new(Allocator *allocator);
 
 // Frees the given string buffer
 void string_buf_free(StringBuffer* self);
 
-// Pushes a string representation of the given value into the buffer
+// Pushes the given characters into the buffer
+void string_buf_write(StringBuffer *self, const char *chars, int length);
+
+// Pushes a string representation of the given value into the buffer, this
+// is the common serializer of values, for printing and string conversions
 void string_buf_push(StringBuffer *self, Value value);
 
+// Pushes the string representations of the given values into the buffer,
+// growing it once to the estimated size of all of them
+void string_buf_push_values(StringBuffer *self, Value *values, int count);
+
 // Consumes the given string buffer and converts it into a string object
 RavString *string_buf_into(StringBuffer *self);
 
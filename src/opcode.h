@@ -7,6 +7,7 @@ Opcode(OP_PUSH_TRUE)
 Opcode(OP_PUSH_FALSE)
 Opcode(OP_PUSH_NIL)
 Opcode(OP_PUSH_CONST)     // 1-byte constant index
+Opcode(OP_PUSH_CONST_16)  // 2-bytes constant index
 
 // X Register
 Opcode(OP_PUSH_X)
@@ -15,6 +16,7 @@ Opcode(OP_POP_X)
 Opcode(OP_DUP)
 Opcode(OP_POP)
 Opcode(OP_POPN)           // 1-byte count
+Opcode(OP_POPN_16)        // 2-bytes count
 
 // Arithmetics
 Opcode(OP_ADD)
@@ -43,6 +45,15 @@ Opcode(OP_GET_LOCAL)      // 1-byte stack slot index
 Opcode(OP_SET_UPVALUE)    // 1-byte upvalue list index
 Opcode(OP_GET_UPVALUE)    // 1-byte upvalue list index
 
+// Variables (Wide), same order as above
+Opcode(OP_DEF_GLOBAL_16)  // 2-bytes global buffer index
+Opcode(OP_SET_GLOBAL_16)  // 2-bytes global buffer index
+Opcode(OP_GET_GLOBAL_16)  // 2-bytes global buffer index
+Opcode(OP_SET_LOCAL_16)   // 2-bytes stack slot index
+Opcode(OP_GET_LOCAL_16)   // 2-bytes stack slot index
+Opcode(OP_SET_UPVALUE_16) // 2-bytes upvalue list index
+Opcode(OP_GET_UPVALUE_16) // 2-bytes upvalue list index
+
 // Branching
 Opcode(OP_CALL)           // 1-byte arguments count
 Opcode(OP_JMP)            // 2-bytes offset
@@ -50,13 +61,21 @@ Opcode(OP_JMP_BACK)       // 2-bytes offset
 Opcode(OP_JMP_FALSE)      // 2-bytes offset
 Opcode(OP_JMP_POP_FALSE)  // 2-bytes offset
 
+// Iteration, the subject, its end, the resizes of maps and the state are
+// kept in four stack slots
+Opcode(OP_ITER_INIT)      // 1-byte range flag
+Opcode(OP_ITER_NEXT)      // 2-bytes exit offset
+
 // Closure
-Opcode(OP_CLOSURE)        // 1-byte function index
+Opcode(OP_CLOSURE)        // 1-byte function index, upvalues descriptors
+Opcode(OP_CLOSURE_16)     // 2-bytes function index, upvalues descriptors
 Opcode(OP_CLOSE_UPVALUE)
 
 // Collections
 Opcode(OP_CONCAT)
+Opcode(OP_INTERPOLATE)    // 1-byte number of parts
 Opcode(OP_CONS)
+Opcode(OP_LIST)           // 1-byte number of heads
 Opcode(OP_ARRAY_8)        // 1-byte number of elements
 Opcode(OP_ARRAY_16)       // 2-bytes number of elements
 Opcode(OP_MAP_8)          // 1-byte number of elements
@@ -74,6 +93,7 @@ Opcode(OP_ARRAY_PUSH_ELEMENT)   // 1-byte array index
 
 // Map Operations (Unchecked)
 Opcode(OP_MAP_PUSH_ELEMENT)     // 1-byte name constant index
+Opcode(OP_MAP_PUSH_ELEMENT_16)  // 2-bytes name constant index
 
 // Predicates
 Opcode(OP_IS_PAIR)
@@ -1,7 +1,5 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-#include <errno.h>
 
 #include "common.h"
 #include "vm.h"
@@ -23,55 +21,23 @@ static void repl() {
         }
         InterpretResult result = interpret(&vm, buf, "stdin");
         if (result == INTERPRET_OK) {
-            value_print(vm.x);
-            putchar('\n');
+            vm_print(&vm, vm.x);
         }
+        vm_flush(&vm);
     }
 
     free_vm(&vm);
 }
 
-static char *scan_file(const char *path) {
-    FILE *file = fopen(path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Fatal: error openning '%s' (%s)\n", path, strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-
-    fseek(file, 0L, SEEK_END);
-    size_t size = ftell(file);
-    rewind(file);
-
-    char *buf = (char *)malloc(size + 1);
-    if (buf == NULL) {
-        fprintf(stderr, "Fatal: not enough memory to scan '%s'\n", path);
-        exit(EXIT_FAILURE);
-    }
-
-    size_t bytes_read = fread(buf, sizeof (char), size, file);
-    if (bytes_read < size || ferror(file)) {
-        fprintf(stderr, "Fatal: error reading '%s' (%s)\n", path, strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-
-    fclose(file);
-
-    buf[size] = '\0';
-    return buf;
-}
-
 static void execute_file(const char *path) {
     VM vm;
     init_vm(&vm);
 
-    char *source = scan_file(path);
-    InterpretResult result = interpret(&vm, source, path);
+    InterpretResult result = interpret_file(&vm, path);
     if (result == INTERPRET_OK) {
-        value_print(vm.x);
-        putchar('\n');
+        vm_print(&vm, vm.x);
     }
 
-    free(source);
     free_vm(&vm);
 
     if (result == INTERPRET_RUNTIME_ERROR) exit(EXIT_FAILURE);
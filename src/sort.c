@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "object.h"
+#include "sort.h"
+#include "value.h"
+
+// Ranges of this length or shorter are sorted by insertion.
+#define INSERTION_THRESHOLD 16
+
+// Arrays of this length or shorter aren't worth the radix sort passes.
+#define RADIX_THRESHOLD 64
+
+/// Introsort
+
+static inline void swap(Value *x, Value *y) {
+    Value temporary = *x;
+    *x = *y;
+    *y = temporary;
+}
+
+// Insertion by swaps, rather than by shifting the elements after a held
+// one, which would be unreachable by the GC while the order is called.
+static void insertion_sort(Value *values, size_t count, SortLess less, void *context) {
+    for (size_t i = 1; i < count; i++) {
+        for (size_t j = i; j > 0 && less(context, values[j], values[j - 1]); j--) {
+            swap(&values[j], &values[j - 1]);
+        }
+    }
+}
+
+static void sift_down(Value *values, size_t root, size_t count, SortLess less, void *context) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= count) {
+            return;
+        }
+        if (child + 1 < count && less(context, values[child], values[child + 1])) {
+            child++;
+        }
+        if (!less(context, values[root], values[child])) {
+            return;
+        }
+
+        swap(&values[root], &values[child]);
+        root = child;
+    }
+}
+
+static void heap_sort(Value *values, size_t count, SortLess less, void *context) {
+    for (size_t i = count / 2; i-- > 0;) {
+        sift_down(values, i, count, less, context);
+    }
+    for (size_t end = count - 1; end > 0; end--) {
+        swap(&values[0], &values[end]);
+        sift_down(values, 0, end, less, context);
+    }
+}
+
+// Order the three values in place.
+static void sort3(Value *x, Value *y, Value *z, SortLess less, void *context) {
+    if (less(context, *y, *x)) swap(x, y);
+    if (less(context, *z, *y)) swap(y, z);
+    if (less(context, *y, *x)) swap(x, y);
+}
+
+static void intro_sort(Value *values, size_t count, int depth, SortLess less, void *context) {
+    while (count > INSERTION_THRESHOLD) {
+        if (depth-- == 0) {
+            heap_sort(values, count, less, context);
+            return;
+        }
+
+        // the median of three is the pivot, moved to the first slot
+        size_t middle = count / 2;
+        sort3(&values[1], &values[middle], &values[count - 1], less, context);
+        swap(&values[0], &values[middle]);
+
+        // the scans are bounded, the order may be inconsistent
+        size_t i = 0, j = count;
+        for (;;) {
+            do i++; while (i < count && less(context, values[i], values[0]));
+            do j--; while (j > 0 && less(context, values[0], values[j]));
+            if (i >= j) break;
+            swap(&values[i], &values[j]);
+        }
+        swap(&values[0], &values[j]);
+
+        // recurse into the shorter side, and loop over the longer one
+        size_t left = j, right = count - j - 1;
+        if (left < right) {
+            intro_sort(values, left, depth, less, context);
+            values += j + 1;
+            count = right;
+        } else {
+            intro_sort(values + j + 1, right, depth, less, context);
+            count = left;
+        }
+    }
+
+    insertion_sort(values, count, less, context);
+}
+
+void sort_values(Value *values, size_t count, SortLess less, void *context) {
+    int depth = 0;
+    for (size_t n = count; n > 1; n >>= 1) {
+        depth += 2;
+    }
+
+    intro_sort(values, count, depth, less, context);
+}
+
+/// Radix Sort
+
+// Sort the keys, and the values alongside them if there are any, by
+// 8-bit digits from the least significant one. Digits shared by all the
+// keys are skipped.
+static void radix_sort(uint64_t *keys, Value *values, size_t count) {
+    size_t (*counts)[256] = calloc(8, sizeof *counts);
+    for (size_t i = 0; i < count; i++) {
+        for (int digit = 0; digit < 8; digit++) {
+            counts[digit][keys[i] >> (digit * 8) & 0xff]++;
+        }
+    }
+
+    // the passes alternate between the arrays and the buffers
+    uint64_t *keys_buffer = malloc(count * sizeof (uint64_t));
+    Value *values_buffer = values ? malloc(count * sizeof (Value)) : NULL;
+    uint64_t *from_keys = keys, *to_keys = keys_buffer;
+    Value *from_values = values, *to_values = values_buffer;
+
+    for (int digit = 0; digit < 8; digit++) {
+        int shift = digit * 8;
+        size_t *digit_counts = counts[digit];
+        if (digit_counts[keys[0] >> shift & 0xff] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int d = 0; d < 256; d++) {
+            size_t digit_count = digit_counts[d];
+            digit_counts[d] = offset;
+            offset += digit_count;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            size_t position = digit_counts[from_keys[i] >> shift & 0xff]++;
+            to_keys[position] = from_keys[i];
+            if (values) to_values[position] = from_values[i];
+        }
+
+        uint64_t *keys_swap = from_keys;
+        from_keys = to_keys;
+        to_keys = keys_swap;
+
+        Value *values_swap = from_values;
+        from_values = to_values;
+        to_values = values_swap;
+    }
+
+    if (from_keys != keys) {
+        memcpy(keys, from_keys, count * sizeof (uint64_t));
+        if (values) memcpy(values, from_values, count * sizeof (Value));
+    }
+
+    free(values_buffer);
+    free(keys_buffer);
+    free(counts);
+}
+
+// Map the number to an unsigned integer of the same order, negative
+// numbers have all their bits flipped, and positive ones the sign bit.
+static inline uint64_t number_key(double number) {
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof bits);
+    return bits >> 63 ? ~bits : bits | (uint64_t)1 << 63;
+}
+
+static inline double key_number(uint64_t key) {
+    uint64_t bits = key >> 63 ? key & ~((uint64_t)1 << 63) : ~key;
+    double number;
+    memcpy(&number, &bits, sizeof number);
+    return number;
+}
+
+void sort_numbers(double *numbers, size_t count) {
+    if (count <= RADIX_THRESHOLD) {
+        for (size_t i = 1; i < count; i++) {
+            double number = numbers[i];
+            uint64_t key = number_key(number);
+
+            size_t j = i;
+            for (; j > 0 && number_key(numbers[j - 1]) > key; j--) {
+                numbers[j] = numbers[j - 1];
+            }
+            numbers[j] = number;
+        }
+        return;
+    }
+
+    uint64_t *keys = malloc(count * sizeof (uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = number_key(numbers[i]);
+    }
+
+    radix_sort(keys, NULL, count);
+
+    for (size_t i = 0; i < count; i++) {
+        numbers[i] = key_number(keys[i]);
+    }
+    free(keys);
+}
+
+static bool text_less(void *context, Value x, Value y) {
+    MAYBE_UNUSED(context);
+
+    int x_length, y_length;
+    const char *x_chars = object_text(x, &x_length);
+    const char *y_chars = object_text(y, &y_length);
+
+    int result = memcmp(x_chars, y_chars, x_length < y_length ? x_length : y_length);
+    return result < 0 || (result == 0 && x_length < y_length);
+}
+
+// The first 8 bytes of the text in big endian order, padded with zeros.
+static inline uint64_t text_key(Value value) {
+    int length;
+    const char *chars = object_text(value, &length);
+
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key = key << 8 | (i < length ? (uint8_t)chars[i] : 0);
+    }
+    return key;
+}
+
+void sort_texts(Value *values, size_t count) {
+    if (count <= RADIX_THRESHOLD) {
+        sort_values(values, count, text_less, NULL);
+        return;
+    }
+
+    // sort by the prefixes, then the texts which share a prefix
+    uint64_t *keys = malloc(count * sizeof (uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = text_key(values[i]);
+    }
+
+    radix_sort(keys, values, count);
+
+    for (size_t i = 0, j; i < count; i = j) {
+        for (j = i + 1; j < count && keys[j] == keys[i]; j++);
+        if (j - i > 1) {
+            sort_values(values + i, j - i, text_less, NULL);
+        }
+    }
+    free(keys);
+}
+
+#undef RADIX_THRESHOLD
+#undef INSERTION_THRESHOLD
@@ -0,0 +1,31 @@
+#ifndef raven_sort_h
+#define raven_sort_h
+
+// Sorting
+//
+// Arrays of values are sorted with an introsort (quicksort falling back
+// to heapsort on deep recursion, and to insertion sort on short ranges)
+// over a caller provided order. Numbers and strings without a custom
+// order are sorted with an LSD radix sort.
+
+#include "common.h"
+#include "value.h"
+
+// Return true if `x` must be ordered before `y`, must be a strict weak
+// ordering for the result to be sorted, but a failing order never leads
+// to out of bounds accesses.
+typedef bool (*SortLess)(void *context, Value x, Value y);
+
+// Sort the values in place, the sort isn't stable. The elements are only
+// swapped within the array, so they stay reachable by the GC while the
+// order function is called.
+void sort_values(Value *values, size_t count, SortLess less, void *context);
+
+// Sort the numbers in ascending order, -0 is ordered before 0, and NaNs
+// at the ends according to their sign bit.
+void sort_numbers(double *numbers, size_t count);
+
+// Sort string and slice values in lexicographic order of their bytes.
+void sort_texts(Value *values, size_t count);
+
+#endif
@@ -1,16 +1,98 @@
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #include "common.h"
 #include "object.h"
 #include "table.h"
 #include "value.h"
 
-#define TABLE_MAX_LOAD 0.75
+// Tables are rehashed when more than 7/8 of the entries are live or
+// deleted, so probes always end at a group with an empty entry. They're
+// rehashed into the smallest capacity which is at most half loaded with
+// the live entries, that is grown, shrunk or of the same capacity.
+#define Max_Load(capacity) ((capacity) - (capacity) / 8)
+
+#define MIN_CAPACITY 8
+
+// Tables are shrunk when less than 1/8 of their entries are live, by the
+// insertions after removals, and rehashed after the removal of the weak
+// references when more than 1/4 of them are deleted.
+#define Is_Sparse(count, capacity) \
+    ((capacity) > MIN_CAPACITY && (count) < (capacity) / 8)
+#define Is_Fragmented(table, capacity) ((table)->deleted > (capacity) / 4)
+
+#define GROUP_WIDTH 16
+
+// Control bytes of full entries are the 7 top bits of the key hash, the
+// special ones have the sign bit set. Tables smaller than a group have
+// their controls padded with sentinels, which are neither empty nor free.
+#define CONTROL_EMPTY    0x80
+#define CONTROL_DELETED  0xfe
+#define CONTROL_SENTINEL 0xff
+
+#define Hash_Control(hash) ((uint8_t)((hash) >> 25))
+
+/// Groups
+
+// A bit for each entry of a group.
+typedef uint32_t GroupMask;
+
+#ifdef __SSE2__
+
+static inline __m128i group_load(const uint8_t *controls) {
+    return _mm_loadu_si128((const __m128i *)controls);
+}
+
+// Return the entries of the group with the control byte.
+static inline GroupMask group_match(const uint8_t *controls, uint8_t control) {
+    __m128i match = _mm_cmpeq_epi8(group_load(controls), _mm_set1_epi8((char)control));
+    return (GroupMask)_mm_movemask_epi8(match);
+}
+
+// Return the empty and deleted entries of the group, their control bytes
+// are the only ones below the sentinel as signed bytes.
+static inline GroupMask group_free(const uint8_t *controls) {
+    __m128i match = _mm_cmpgt_epi8(_mm_set1_epi8((char)CONTROL_SENTINEL), group_load(controls));
+    return (GroupMask)_mm_movemask_epi8(match);
+}
+
+#else
+
+static inline GroupMask group_match(const uint8_t *controls, uint8_t control) {
+    GroupMask mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (GroupMask)(controls[i] == control) << i;
+    }
+    return mask;
+}
+
+static inline GroupMask group_free(const uint8_t *controls) {
+    GroupMask mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (GroupMask)((int8_t)controls[i] < (int8_t)CONTROL_SENTINEL) << i;
+    }
+    return mask;
+}
+
+#endif
+
+static inline GroupMask group_empty(const uint8_t *controls) {
+    return group_match(controls, CONTROL_EMPTY);
+}
+
+/// Table
 
 void table_init(Table *table) {
     table->entries = NULL;
+    table->controls = NULL;
     table->count = 0;
+    table->deleted = 0;
+    table->removed = 0;
     table->hash_mask = -1;
 }
 
@@ -19,60 +101,230 @@ void table_free(Table *table) {
     table_init(table);
 }
 
-static Entry *find_entry(Entry *entries, RavString *key, int hash_mask) {
-    uint32_t index = key->hash & hash_mask;
-    Entry *tombstone = NULL;
+// Return the same key for equal numbers.
+static inline Value normalize_key(Value key) {
+    if (Is_Num(key)) {
+        double number = As_Num(key);
+        if (number == 0) return Num_Value(0);
+        if (isnan(number)) return Num_Value(NAN);
+    }
+    return key;
+}
+
+// Keys are normalized, so they're equal if their representation is.
+static inline bool key_equal(Value x, Value y) {
+#ifdef NAN_TAGGING
+    return x == y;
+#else
+    if (x.type != y.type) return false;
+    if (x.type != VALUE_NUM) return value_equal(x, y);
+    return memcmp(&x.as.number, &y.as.number, sizeof (double)) == 0;
+#endif
+}
+
+static inline uint32_t mix_hash(uint64_t bits) {
+    return (uint32_t)((bits * UINT64_C(0x9e3779b97f4a7c15)) >> 32);
+}
+
+// Return the bits of the value, which are the same for identical values.
+static inline uint64_t value_bits(Value value) {
+#ifdef NAN_TAGGING
+    return value;
+#else
+    uint64_t bits = 0;
+    if (Is_Obj(value)) {
+        bits = (uint64_t)(uintptr_t)As_Obj(value);
+    } else if (Is_Num(value)) {
+        double number = As_Num(value);
+        memcpy(&bits, &number, sizeof bits);
+    } else if (Is_Bool(value)) {
+        bits = As_Bool(value) ? 2 : 1;
+    }
+    return bits;
+#endif
+}
+
+static inline uint32_t pair_hash(Value head, Value tail) {
+    return mix_hash(value_bits(head) * UINT64_C(0xff51afd7ed558ccd) ^ value_bits(tail));
+}
+
+static inline uint32_t hash_key(Value key) {
+    if (Is_Obj(key)) {
+        Object *object = As_Obj(key);
+        if (object->type == OBJ_STRING) {
+            return ((RavString *)object)->hash;
+        }
+        if (object->type == OBJ_PAIR) {
+            RavPair *pair = (RavPair *)object;
+            return pair_hash(pair->head, object_pair_tail(pair));
+        }
+    }
+    return mix_hash(value_bits(key));
+}
+
+// The probe sequence visits the groups starting from the one selected by
+// the low bits of the hash, groups are only as many as the entries of
+// tables smaller than a group, that is one.
+#define Probe_Start(table, hash)                                \
+    int group_mask = (table)->hash_mask / GROUP_WIDTH;          \
+    int group = (hash) & group_mask;                            \
+    int step = 0
+
+#define Probe_Next()                                            \
+    do {                                                        \
+        step++;                                                 \
+        group = (group + step) & group_mask;                    \
+    } while (false)
+
+static inline Entry *find_entry(Table *table, Value key, uint32_t hash) {
+    uint8_t control = Hash_Control(hash);
+    Probe_Start(table, hash);
 
     for (;;) {
-        Entry *entry = &entries[index];
+        const uint8_t *controls = &table->controls[group * GROUP_WIDTH];
 
-        if (entry->key == NULL) {
-            if (Is_Nil(entry->value)) {
-                return tombstone ? tombstone : entry;
+        for (GroupMask match = group_match(controls, control); match; match &= match - 1) {
+            Entry *entry = &table->entries[group * GROUP_WIDTH + __builtin_ctz(match)];
+            if (key_equal(entry->key, key)) {
+                return entry;
             }
-
-            if (tombstone == NULL) tombstone = entry;
-        } else if (entry->key == key) {
-            return entry;
         }
 
-        index = (index + 1) & hash_mask;
+        if (group_empty(controls)) {
+            return NULL;
+        }
+        Probe_Next();
     }
 }
 
-static void adjust_capacity(Table *table, int hash_mask) {
-    Entry *entries = malloc((hash_mask + 1) * sizeof (Entry));
+// Return the index of the first empty or deleted entry of the probe
+// sequence, there's always one under the maximum load.
+static inline int find_free(Table *table, uint32_t hash) {
+    Probe_Start(table, hash);
 
-    for (int i = 0; i <= hash_mask; i++) {
-        entries[i].key = NULL;
-        entries[i].value = Nil_Value;
+    for (;;) {
+        GroupMask match = group_free(&table->controls[group * GROUP_WIDTH]);
+        if (match) {
+            return group * GROUP_WIDTH + __builtin_ctz(match);
+        }
+        Probe_Next();
     }
+}
+
+static void adjust_capacity(Table *table, int capacity) {
+    int controls_size = capacity < GROUP_WIDTH ? GROUP_WIDTH : capacity;
+    Table adjusted;
+    adjusted.entries = malloc(capacity * sizeof (Entry) + controls_size);
+    adjusted.controls = (uint8_t *)(adjusted.entries + capacity);
+    adjusted.count = table->count;
+    adjusted.deleted = 0;
+    adjusted.removed = 0;
+    adjusted.hash_mask = capacity - 1;
+
+    for (int i = 0; i < capacity; i++) {
+        adjusted.entries[i].key = Nil_Value;
+    }
+    memset(adjusted.controls, CONTROL_EMPTY, capacity);
+    memset(adjusted.controls + capacity, CONTROL_SENTINEL, controls_size - capacity);
 
-    table->count = 0;
     for (int i = 0; i <= table->hash_mask; i++) {
         Entry *entry = &table->entries[i];
-        if (entry->key == NULL) {
+        if (Is_Nil(entry->key)) {
             continue;
         }
 
-        Entry *copy = find_entry(entries, entry->key, hash_mask);
-        copy->key = entry->key;
-        copy->value = entry->value;
-        table->count++;
+        uint32_t hash = hash_key(entry->key);
+        int index = find_free(&adjusted, hash);
+        adjusted.controls[index] = Hash_Control(hash);
+        adjusted.entries[index] = *entry;
     }
 
     free(table->entries);
-    table->entries = entries;
-    table->hash_mask = hash_mask;
+    *table = adjusted;
+}
+
+// Rehash the entries within the same entries array, which are marked
+// deleted first, and then moved to the first free entry of their probe
+// sequence, or left in place if it's in the same group. An entry is moved
+// into an entry which is still to be rehashed by swapping the two.
+static void rehash_in_place(Table *table) {
+    int capacity = table->hash_mask + 1;
+
+    for (int i = 0; i < capacity; i++) {
+        uint8_t control = table->controls[i];
+        table->controls[i] = control == CONTROL_DELETED ? CONTROL_EMPTY
+                           : control == CONTROL_EMPTY ? CONTROL_EMPTY
+                           : CONTROL_DELETED;
+    }
+
+    for (int i = 0; i < capacity; i++) {
+        if (table->controls[i] != CONTROL_DELETED) {
+            continue;
+        }
+
+        uint32_t hash = hash_key(table->entries[i].key);
+        int index = find_free(table, hash);
+
+        if (index / GROUP_WIDTH == i / GROUP_WIDTH) {
+            table->controls[i] = Hash_Control(hash);
+        } else if (table->controls[index] == CONTROL_EMPTY) {
+            table->controls[index] = Hash_Control(hash);
+            table->entries[index] = table->entries[i];
+            table->controls[i] = CONTROL_EMPTY;
+            table->entries[i].key = Nil_Value;
+        } else {
+            table->controls[index] = Hash_Control(hash);
+            Entry entry = table->entries[index];
+            table->entries[index] = table->entries[i];
+            table->entries[i] = entry;
+            i--;
+        }
+    }
+
+    table->deleted = 0;
+    table->removed = 0;
+}
+
+// Rehash the table into the capacity for the count of entries.
+static void rehash_table(Table *table, int count) {
+    int capacity = MIN_CAPACITY;
+    while (count * 2 > Max_Load(capacity)) {
+        capacity *= 2;
+    }
+
+    if (capacity == table->hash_mask + 1) {
+        rehash_in_place(table);
+    } else {
+        adjust_capacity(table, capacity);
+    }
+}
+
+// Mark the entry as removed. It's marked empty, rather than deleted, if
+// its group already has an empty entry, since no probe sequence goes past
+// that group then.
+static inline void remove_entry(Table *table, Entry *entry) {
+    int index = (int)(entry - table->entries);
+    const uint8_t *controls = &table->controls[index / GROUP_WIDTH * GROUP_WIDTH];
+
+    if (group_empty(controls)) {
+        table->controls[index] = CONTROL_EMPTY;
+    } else {
+        table->controls[index] = CONTROL_DELETED;
+        table->deleted++;
+    }
+
+    entry->key = Nil_Value;
+    table->count--;
 }
 
-bool table_get(Table *table, RavString *key, Value *value) {
+bool table_get(Table *table, Value key, Value *value) {
     if (table->count == 0) {
         return false;
     }
 
-    Entry *entry = find_entry(table->entries, key, table->hash_mask);
-    if (entry->key == NULL) {
+    key = normalize_key(key);
+    Entry *entry = find_entry(table, key, hash_key(key));
+    if (entry == NULL) {
         return false;
     }
 
@@ -80,40 +332,51 @@ bool table_get(Table *table, RavString *key, Value *value) {
     return true;
 }
 
-bool table_set(Table *table, RavString *key, Value value) {
-    int capacity = table->hash_mask + 1;
+bool table_set(Table *table, Value key, Value value) {
+    assert(!Is_Nil(key));
+    key = normalize_key(key);
+    uint32_t hash = hash_key(key);
 
-    if (table->count >= capacity * TABLE_MAX_LOAD) {
-        int new_capacity = Grow_Capacity(capacity);
-        adjust_capacity(table, new_capacity - 1);
+    if (table->count > 0) {
+        Entry *entry = find_entry(table, key, hash);
+        if (entry != NULL) {
+            entry->value = value;
+            return false;
+        }
     }
 
-    Entry *entry = find_entry(table->entries, key, table->hash_mask);
+    int capacity = table->hash_mask + 1;
+    if (table->count + table->deleted >= Max_Load(capacity) ||
+        (table->removed > 0 && Is_Sparse(table->count, capacity))) {
+        rehash_table(table, table->count);
+    }
 
-    bool is_new_key = entry->key == NULL;
-    if (is_new_key && Is_Nil(entry->value)) {
-        table->count++;
+    int index = find_free(table, hash);
+    if (table->controls[index] == CONTROL_DELETED) {
+        table->deleted--;
     }
+    table->controls[index] = Hash_Control(hash);
+    table->entries[index].key = key;
+    table->entries[index].value = value;
+    table->count++;
 
-    entry->key = key;
-    entry->value = value;
-    return is_new_key;
+    return true;
 }
 
-Value table_remove(Table *table, RavString *key) {
+Value table_remove(Table *table, Value key) {
     if (table->count == 0) {
         return Nil_Value;
     }
 
-    Entry *entry = find_entry(table->entries, key, table->hash_mask);
-    if (entry->key == NULL) {
+    key = normalize_key(key);
+    Entry *entry = find_entry(table, key, hash_key(key));
+    if (entry == NULL) {
         return Nil_Value;
     }
 
     Value value = entry->value;
-    entry->key = NULL;
-    entry->value = Bool_Value(false); // Any non-nil value
-
+    remove_entry(table, entry);
+    table->removed++;
     return value;
 }
 
@@ -121,7 +384,7 @@ void table_copy(Table *from, Table *to) {
     for (int i = 0; i <= from->hash_mask; i++) {
         Entry *entry = &from->entries[i];
 
-        if (entry->key) {
+        if (!Is_Nil(entry->key)) {
             table_set(to, entry->key, entry->value);
         }
     }
@@ -132,16 +395,15 @@ RavString *table_interned(Table *table, const char *chars, uint32_t hash, int le
         return NULL;
     }
 
-    uint32_t index = hash & table->hash_mask;
+    uint8_t control = Hash_Control(hash);
+    Probe_Start(table, hash);
+
     for (;;) {
-        Entry *entry = &table->entries[index];
+        const uint8_t *controls = &table->controls[group * GROUP_WIDTH];
 
-        if (entry->key == NULL) {
-            if (Is_Nil(entry->value)) {
-                return NULL;
-            }
-        } else {
-            RavString *key = entry->key;
+        for (GroupMask match = group_match(controls, control); match; match &= match - 1) {
+            Entry *entry = &table->entries[group * GROUP_WIDTH + __builtin_ctz(match)];
+            RavString *key = As_String(entry->key);
             if (key->length == length &&
                 key->hash == hash &&
                 memcmp(key->chars, chars, length) == 0) {
@@ -149,16 +411,243 @@ RavString *table_interned(Table *table, const char *chars, uint32_t hash, int le
             }
         }
 
-        index = (index + 1) & table->hash_mask;
+        if (group_empty(controls)) {
+            return NULL;
+        }
+        Probe_Next();
+    }
+}
+
+RavPair *table_consed(Table *table, Value head, Value tail) {
+    if (table->count == 0) {
+        return NULL;
+    }
+
+    uint32_t hash = pair_hash(head, tail);
+    uint8_t control = Hash_Control(hash);
+    Probe_Start(table, hash);
+
+    for (;;) {
+        const uint8_t *controls = &table->controls[group * GROUP_WIDTH];
+
+        for (GroupMask match = group_match(controls, control); match; match &= match - 1) {
+            Entry *entry = &table->entries[group * GROUP_WIDTH + __builtin_ctz(match)];
+            RavPair *key = As_Pair(entry->key);
+            if (key_equal(key->head, head) && key_equal(object_pair_tail(key), tail)) {
+                return key;
+            }
+        }
+
+        if (group_empty(controls)) {
+            return NULL;
+        }
+        Probe_Next();
     }
 }
 
 void table_remove_weak(Table *table) {
+    int count = table->count;
+
     for (int i = 0; i <= table->hash_mask; i++) {
         Entry *entry = &table->entries[i];
 
-        if (entry->key != NULL && !entry->key->header.marked) {
-            table_remove(table, entry->key);
+        if (!Is_Nil(entry->key) && !allocator_marked(As_Obj(entry->key))) {
+            remove_entry(table, entry);
+        }
+    }
+
+    // the table is sized for the entries before the removal, as much of
+    // them are added again until the next GC
+    int capacity = table->hash_mask + 1;
+    if (Is_Sparse(count, capacity) || Is_Fragmented(table, capacity)) {
+        rehash_table(table, count);
+    }
+}
+
+/// Dictionary
+
+// At most 2/3 of the indices are used, entries are allocated for them.
+#define Dict_Usable(size) ((size) * 2 / 3)
+
+#define INDEX_EMPTY (-1)
+
+// The indices are 8-bit for up to 256 of them, 16-bit for up to 65536,
+// and 32-bit otherwise, with all bits set for empty ones.
+static inline size_t index_width(int hash_mask) {
+    return hash_mask <= UINT8_MAX ? 1 : hash_mask <= UINT16_MAX ? 2 : 4;
+}
+
+static inline int index_get(Dict *dict, int slot) {
+    if (dict->hash_mask <= UINT8_MAX) {
+        uint8_t index = ((uint8_t *)dict->indices)[slot];
+        return index == UINT8_MAX ? INDEX_EMPTY : index;
+    }
+    if (dict->hash_mask <= UINT16_MAX) {
+        uint16_t index = ((uint16_t *)dict->indices)[slot];
+        return index == UINT16_MAX ? INDEX_EMPTY : index;
+    }
+    return ((int32_t *)dict->indices)[slot];
+}
+
+static inline void index_set(Dict *dict, int slot, int index) {
+    if (dict->hash_mask <= UINT8_MAX) {
+        ((uint8_t *)dict->indices)[slot] = (uint8_t)index;
+    } else if (dict->hash_mask <= UINT16_MAX) {
+        ((uint16_t *)dict->indices)[slot] = (uint16_t)index;
+    } else {
+        ((int32_t *)dict->indices)[slot] = index;
+    }
+}
+
+void dict_init(Dict *dict) {
+    dict->entries = NULL;
+    dict->indices = NULL;
+    dict->count = 0;
+    dict->used = 0;
+    dict->hash_mask = -1;
+    dict->resizes = 0;
+}
+
+void dict_free(Dict *dict) {
+    free(dict->entries);
+    dict_init(dict);
+}
+
+// Return the entry of the key, or NULL and set `slot` to the empty index
+// which ends its probe sequence. Removed entries keep their indices, and
+// never match since their keys are nil.
+static inline Entry *dict_find(Dict *dict, Value key, uint32_t hash, int *slot) {
+    int index_slot = hash & dict->hash_mask;
+
+    for (;;) {
+        int index = index_get(dict, index_slot);
+        if (index == INDEX_EMPTY) {
+            *slot = index_slot;
+            return NULL;
+        }
+
+        Entry *entry = &dict->entries[index];
+        if (key_equal(entry->key, key)) {
+            return entry;
+        }
+
+        index_slot = (index_slot + 1) & dict->hash_mask;
+    }
+}
+
+// Move the live entries, in order, into new arrays with twice as many
+// usable entries as them.
+static void dict_resize(Dict *dict) {
+    int size = MIN_CAPACITY;
+    while (Dict_Usable(size) < dict->count * 2) {
+        size *= 2;
+    }
+
+    Dict resized;
+    int usable = Dict_Usable(size);
+    size_t width = index_width(size - 1);
+    resized.entries = malloc(usable * sizeof (Entry) + size * width);
+    resized.indices = resized.entries + usable;
+    resized.count = dict->count;
+    resized.used = 0;
+    resized.hash_mask = size - 1;
+    resized.resizes = dict->resizes + 1;
+    memset(resized.indices, 0xff, size * width);
+
+    for (int i = 0; i < dict->used; i++) {
+        Entry *entry = &dict->entries[i];
+        if (Is_Nil(entry->key)) {
+            continue;
+        }
+
+        int slot = 0;
+        dict_find(&resized, entry->key, hash_key(entry->key), &slot);
+        index_set(&resized, slot, resized.used);
+        resized.entries[resized.used++] = *entry;
+    }
+
+    free(dict->entries);
+    *dict = resized;
+}
+
+bool dict_get(Dict *dict, Value key, Value *value) {
+    if (dict->count == 0) {
+        return false;
+    }
+
+    int slot;
+    key = normalize_key(key);
+    Entry *entry = dict_find(dict, key, hash_key(key), &slot);
+    if (entry == NULL) {
+        return false;
+    }
+
+    *value = entry->value;
+    return true;
+}
+
+bool dict_set(Dict *dict, Value key, Value value) {
+    assert(!Is_Nil(key));
+    key = normalize_key(key);
+    uint32_t hash = hash_key(key);
+
+    int slot = 0;
+    if (dict->hash_mask >= 0) {
+        Entry *entry = dict_find(dict, key, hash, &slot);
+        if (entry != NULL) {
+            entry->value = value;
+            return false;
         }
     }
+
+    // the entries are compacted once they're all used, or once most of
+    // them are removed, which shrinks the arrays
+    int usable = Dict_Usable(dict->hash_mask + 1);
+    if (dict->used == usable ||
+        (dict->used > dict->count && dict->count < usable / 8)) {
+        dict_resize(dict);
+        dict_find(dict, key, hash, &slot);
+    }
+
+    index_set(dict, slot, dict->used);
+    Entry *entry = &dict->entries[dict->used++];
+    entry->key = key;
+    entry->value = value;
+    dict->count++;
+
+    return true;
+}
+
+Value dict_remove(Dict *dict, Value key) {
+    if (dict->count == 0) {
+        return Nil_Value;
+    }
+
+    int slot;
+    key = normalize_key(key);
+    Entry *entry = dict_find(dict, key, hash_key(key), &slot);
+    if (entry == NULL) {
+        return Nil_Value;
+    }
+
+    Value value = entry->value;
+    entry->key = Nil_Value;
+    entry->value = Nil_Value;
+    dict->count--;
+
+    return value;
 }
+
+#undef INDEX_EMPTY
+#undef Dict_Usable
+#undef Probe_Next
+#undef Probe_Start
+#undef Hash_Control
+#undef CONTROL_SENTINEL
+#undef CONTROL_DELETED
+#undef CONTROL_EMPTY
+#undef GROUP_WIDTH
+#undef Is_Fragmented
+#undef Is_Sparse
+#undef MIN_CAPACITY
+#undef Max_Load
@@ -1,20 +1,42 @@
 #ifndef raven_table_h
 #define raven_table_h
 
-// Simple linear probing hash table
+// Swiss table
+//
+// Open addressing hash table, with a control byte per entry beside the
+// entries array. A control byte is either empty, deleted (a tombstone),
+// or the 7 top bits of the key hash, so the entries of a group of 16 are
+// matched against a key with a couple of SSE2 instructions, and only the
+// entries whose hash bits match are compared. Groups are probed in
+// triangular steps, which visit all of them.
+//
+// Keys are any values but nil: strings are compared by identity, so they
+// must be interned, numbers by value, with -0 and 0 being the same key,
+// as are all NaNs, and other objects by identity. Pairs are immutable, so
+// they're hashed by their heads and tails, to be found by them when they
+// are hash-consed. The keys of empty and deleted entries are nil, so the
+// entries are iterated over without the control bytes.
+//
+// Tables are rehashed by insertions, which reclaim the deleted entries,
+// and shrink the tables which have few live entries left after removals.
+// Removals never move the other entries, so a table may be iterated over
+// while its entries are removed.
 
 #include "common.h"
 #include "value.h"
 
 typedef struct {
-    RavString *key;
+    Value key;
     Value value;
 } Entry;
 
 typedef struct {
     Entry *entries;
-    int count;
-    int hash_mask;
+    uint8_t *controls; // allocated after the entries, in the same block
+    int count;         // live entries
+    int deleted;       // tombstones
+    int removed;       // removals since the last rehash
+    int hash_mask;     // capacity - 1, or -1 if there are no entries
 } Table;
 
 // Initialize table state.
@@ -25,16 +47,16 @@ void table_free(Table *table);
 
 // Set value to the value corresponding to key if it's found.
 // Return true if a value is found, false otherwise.
-bool table_get(Table *table, RavString *key, Value *value);
+bool table_get(Table *table, Value key, Value *value);
 
 // Set the value corresponding to key to value, or add a new
 // value if there is no entry for the key.
 // Return true if it's a new value, false otherwise.
-bool table_set(Table *table, RavString *key, Value value);
+bool table_set(Table *table, Value key, Value value);
 
 // Remove the value corresponding to key, if it's found.
 // Return the removed value if it existed, or nil otherwise.
-Value table_remove(Table *table, RavString *key);
+Value table_remove(Table *table, Value key);
 
 // Copy every entry from a table to another.
 void table_copy(Table *from, Table *to);
@@ -43,7 +65,52 @@ void table_copy(Table *from, Table *to);
 // the table entries, otherwise return NULL.
 RavString *table_interned(Table *table, const char *chars, uint32_t hash, int length);
 
-// Remove the weak referenced strings objects (unreachable white objects).
+// Return the hash-consed pair key, if there is one in the table entries
+// with the same head and tail, otherwise return NULL.
+RavPair *table_consed(Table *table, Value head, Value tail);
+
+// Remove the weak referenced objects (unreachable white objects).
 void table_remove_weak(Table *table);
 
+// Ordered dictionary
+//
+// Compact hash table of maps, which keep their entries in the insertion
+// order. The entries are in a dense array, and the hash table is an array
+// of indices into it, of 8, 16 or 32 bits by its size, probed linearly.
+// Keys are the same as the keys of tables.
+//
+// Removed entries have nil keys, and stay in the entries array, so they
+// may be removed while iterating over the entries, until the array is
+// full, then the live entries are moved into a new array, grown or shrunk
+// for their count. Iterators keep an index into the entries, which is
+// stale once they're moved, so they're counted in `resizes`.
+
+typedef struct {
+    Entry *entries; // in insertion order, up to `used`
+    void *indices;  // allocated after the entries, in the same block
+    int count;      // live entries
+    int used;       // live and removed entries
+    int hash_mask;  // indices count - 1, or -1 if there are no entries
+    int resizes;    // times the entries were moved into new arrays
+} Dict;
+
+// Initialize dictionary state.
+void dict_init(Dict *dict);
+
+// Dispose dictionary owned memory.
+void dict_free(Dict *dict);
+
+// Set value to the value corresponding to key if it's found.
+// Return true if a value is found, false otherwise.
+bool dict_get(Dict *dict, Value key, Value *value);
+
+// Set the value corresponding to key to value, or append a new
+// entry if there is no entry for the key.
+// Return true if it's a new entry, false otherwise.
+bool dict_set(Dict *dict, Value key, Value value);
+
+// Remove the value corresponding to key, if it's found.
+// Return the removed value if it existed, or nil otherwise.
+Value dict_remove(Dict *dict, Value key);
+
 #endif
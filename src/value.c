@@ -6,38 +6,11 @@
 #include "value.h"
 
 void value_print(Value value) {
-#ifdef NAN_TAGGING
-    if (Is_Num(value)) {
-        printf("%g", As_Num(value));
-        return;
-    }
-
-    if (Is_Bool(value)) {
-        printf(As_Bool(value) ? "true" : "false");
-        return;
-    }
-
-    if (Is_Nil(value)) {
-        printf("nil");
-        return;
-    }
+    StringBuffer buffer = string_buf_new(NULL);
+    string_buf_push(&buffer, value);
 
-    if (Is_Obj(value)) {
-        object_print(value);
-        return;
-    }
-
-    assert(!"invalid value type");
-#else
-    switch (value.type) {
-    case VALUE_NUM:  printf("%g", As_Num(value)); break;
-    case VALUE_BOOL: printf(As_Bool(value) ? "true" : "false"); break;
-    case VALUE_NIL:  printf("nil"); break;
-    case VALUE_OBJ:  object_print(value); break;
-    default:
-        assert(!"invalid value type");
-    }
-#endif
+    fwrite(buffer.buffer, 1, buffer.count, stdout);
+    string_buf_free(&buffer);
 }
 
 bool value_equal(Value x, Value y) {
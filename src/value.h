@@ -16,6 +16,8 @@ typedef struct RavFunction RavFunction;
 typedef struct RavUpvalue RavUpvalue;
 typedef struct RavClosure RavClosure;
 typedef struct RavCFunction RavCFunction;
+typedef struct RavFile RavFile;
+typedef struct RavSlice RavSlice;
 
 #ifdef NAN_TAGGING
 
@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "vector.h"
+
+// Vectors are as wide as the SIMD registers, with 256-bit registers from
+// AVX, and 128-bit otherwise (SSE2 is a part of x86-64), since wider
+// vectors passed to functions change the ABI.
+#if defined(__AVX__)
+# define LANES 4
+#else
+# define LANES 2
+#endif
+
+typedef double Vector __attribute__((vector_size(LANES * sizeof (double))));
+typedef int64_t Mask __attribute__((vector_size(LANES * sizeof (double))));
+
+// Elements of arrays are only aligned to a double, the loads and stores
+// are done through memcpy, which is compiled to unaligned moves.
+static inline Vector load(const double *numbers) {
+    Vector vector;
+    memcpy(&vector, numbers, sizeof vector);
+    return vector;
+}
+
+static inline void store(double *numbers, Vector vector) {
+    memcpy(numbers, &vector, sizeof vector);
+}
+
+static inline Vector splat(double number) {
+    Vector vector;
+    for (int lane = 0; lane < LANES; lane++) {
+        vector[lane] = number;
+    }
+    return vector;
+}
+
+// Return the lanes of `a` where the mask is set, and of `b` elsewhere.
+static inline Vector select(Mask mask, Vector a, Vector b) {
+    return (Vector)((mask & (Mask)a) | (~mask & (Mask)b));
+}
+
+static inline double lanes_sum(Vector vector) {
+    double sum = 0;
+    for (int lane = 0; lane < LANES; lane++) {
+        sum += vector[lane];
+    }
+    return sum;
+}
+
+double vector_sum(const double *numbers, size_t count) {
+    // two accumulators hide the latency of the additions
+    Vector sum1 = splat(0), sum2 = splat(0);
+    size_t i = 0;
+
+    for (; i + 2 * LANES <= count; i += 2 * LANES) {
+        sum1 += load(numbers + i);
+        sum2 += load(numbers + i + LANES);
+    }
+    for (; i + LANES <= count; i += LANES) {
+        sum1 += load(numbers + i);
+    }
+
+    double sum = lanes_sum(sum1 + sum2);
+    for (; i < count; i++) {
+        sum += numbers[i];
+    }
+    return sum;
+}
+
+double vector_dot(const double *a, const double *b, size_t count) {
+    Vector sum1 = splat(0), sum2 = splat(0);
+    size_t i = 0;
+
+    for (; i + 2 * LANES <= count; i += 2 * LANES) {
+        sum1 += load(a + i) * load(b + i);
+        sum2 += load(a + i + LANES) * load(b + i + LANES);
+    }
+    for (; i + LANES <= count; i += LANES) {
+        sum1 += load(a + i) * load(b + i);
+    }
+
+    double sum = lanes_sum(sum1 + sum2);
+    for (; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// The comparisons are false for NaN, so NaNs are never selected, and are
+// tracked in a separate mask instead.
+double vector_min(const double *numbers, size_t count) {
+    Vector min = splat(INFINITY);
+    Mask nan = {0};
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        Vector vector = load(numbers + i);
+        min = select(vector < min, vector, min);
+        nan |= vector != vector;
+    }
+
+    double result = INFINITY;
+    bool has_nan = false;
+    for (int lane = 0; lane < LANES; lane++) {
+        if (min[lane] < result) result = min[lane];
+        has_nan |= nan[lane] != 0;
+    }
+    for (; i < count; i++) {
+        if (numbers[i] < result) result = numbers[i];
+        has_nan |= isnan(numbers[i]);
+    }
+
+    return has_nan ? NAN : result;
+}
+
+double vector_max(const double *numbers, size_t count) {
+    Vector max = splat(-INFINITY);
+    Mask nan = {0};
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        Vector vector = load(numbers + i);
+        max = select(vector > max, vector, max);
+        nan |= vector != vector;
+    }
+
+    double result = -INFINITY;
+    bool has_nan = false;
+    for (int lane = 0; lane < LANES; lane++) {
+        if (max[lane] > result) result = max[lane];
+        has_nan |= nan[lane] != 0;
+    }
+    for (; i < count; i++) {
+        if (numbers[i] > result) result = numbers[i];
+        has_nan |= isnan(numbers[i]);
+    }
+
+    return has_nan ? NAN : result;
+}
+
+void vector_scale(double *result, const double *numbers, size_t count, double factor) {
+    Vector factors = splat(factor);
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(result + i, load(numbers + i) * factors);
+    }
+    for (; i < count; i++) {
+        result[i] = numbers[i] * factor;
+    }
+}
+
+void vector_fill(double *numbers, size_t count, double number) {
+    Vector vector = splat(number);
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(numbers + i, vector);
+    }
+    for (; i < count; i++) {
+        numbers[i] = number;
+    }
+}
+
+#undef LANES
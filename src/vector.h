@@ -0,0 +1,33 @@
+#ifndef raven_vector_h
+#define raven_vector_h
+
+// Numeric Vector Kernels
+//
+// Loops over arrays of numbers, the elements of packed arrays. They are
+// written with the GCC vector extensions, so they are compiled to the
+// widest SIMD instructions of the target (AVX2 with '-march=native'),
+// and to plain scalar code where there are none.
+
+#include <stddef.h>
+
+// Return the sum of the numbers, the additions are reordered across the
+// vector lanes, so the result may differ from a sequential sum in the
+// last bits for non-integral numbers.
+double vector_sum(const double *numbers, size_t count);
+
+// Return the smallest (or largest) of the numbers, NaN if any of them is
+// NaN, and +Infinity (or -Infinity) if there are none.
+double vector_min(const double *numbers, size_t count);
+double vector_max(const double *numbers, size_t count);
+
+// Return the dot product of two arrays of the same count.
+double vector_dot(const double *a, const double *b, size_t count);
+
+// Write the numbers multiplied by the factor into `result`, which may be
+// the same array.
+void vector_scale(double *result, const double *numbers, size_t count, double factor);
+
+// Set all the numbers to the given number.
+void vector_fill(double *numbers, size_t count, double number);
+
+#endif
@@ -1,14 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <math.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "bytecode.h"
 #include "common.h"
 #include "compiler.h"
 #include "chunk.h"
 #include "value.h"
 #include "object.h"
+#include "sort.h"
+#include "vector.h"
 #include "vm.h"
 
 #ifdef DEBUG_TRACE_EXECUTION
@@ -22,12 +30,14 @@ static const char* type_repr(Value value) {
     if (Is_Bool(value))      return "boolean";
     if (Is_Num(value))       return "number";
     if (Is_String(value))    return "string";
+    if (Is_Slice(value))     return "string";
     if (Is_Pair(value))      return "pair";
     if (Is_Array(value))     return "array";
     if (Is_Map(value))       return "map";
     if (Is_Function(value))  return "function";
     if (Is_Closure(value))   return "function";
     if (Is_CFunction(value)) return "native-function";
+    if (Is_File(value))      return "file";
 
     assert(!"unreachable: invalid value tag");
     return NULL;
@@ -63,13 +73,19 @@ static void runtime_error(VM *vm, const char *format, ...) {
     va_list arguments;
     va_start(arguments, format);
 
-    CallFrame *frame = &vm->frames[vm->frame_count - 1];
-    RavFunction *function = frame->closure->function;
+    // keep the error after the previous output
+    vm_flush(vm);
 
-    // -1 because ip is sitting on the next instruction to be executed.
-    size_t offset = frame->ip - function->chunk.opcodes - 1;
-    int line = chunk_decode_line(&function->chunk, offset);
-    fprintf(stderr, "[%s | line: %d] ", vm->path, line);
+    // calls from outside the vm (see `vm_call`) may fail with no frame
+    if (vm->frame_count > 0) {
+        CallFrame *frame = &vm->frames[vm->frame_count - 1];
+        RavFunction *function = frame->closure->function;
+
+        // -1 because ip is sitting on the next instruction to be executed.
+        size_t offset = frame->ip - function->chunk.opcodes - 1;
+        int line = chunk_decode_line(&function->chunk, offset);
+        fprintf(stderr, "[%s | line: %d] ", vm->path, line);
+    }
 
     vfprintf(stderr, format, arguments);
     putc('\n', stderr);
@@ -98,12 +114,43 @@ static inline bool is_falsy(Value value) {
     return Is_Nil(value) || (Is_Bool(value) && !As_Bool(value));
 }
 
+// Identity equality, except for slices, which are equal to strings and
+// other slices with the same characters.
+static inline bool is_equal(Value x, Value y) {
+    if (value_equal(x, y)) return true;
+    if (!Is_Slice(x) && !Is_Slice(y)) return false;
+    if (!Is_Text(x) || !Is_Text(y)) return false;
+
+    int x_length, y_length;
+    const char *x_chars = object_text(x, &x_length);
+    const char *y_chars = object_text(y, &y_length);
+    return x_length == y_length && memcmp(x_chars, y_chars, x_length) == 0;
+}
+
+// Return the key to look a map up with, strings are interned, so a slice
+// is replaced by its interned string, or by nil if it has none, since it
+// can't be a key then.
+static inline Value lookup_key(VM *vm, Value key) {
+    if (Is_Slice(key)) {
+        RavString *string = object_slice_interned(&vm->allocator, As_Slice(key));
+        return string ? Obj_Value(string) : Nil_Value;
+    }
+    return key;
+}
+
 static inline bool push_frame(VM *vm, RavClosure *closure, int count) {
     if (vm->frame_count == FRAMES_LIMIT) {
         runtime_error(vm, "call stack overflows");
         return false;
     }
 
+    // The locals of the callee must fit in the remaining stack slots.
+    int slots_used = vm->stack_top - vm->stack - count - 1;
+    if (slots_used + closure->function->max_slots > STACK_SIZE) {
+        runtime_error(vm, "stack overflows");
+        return false;
+    }
+
     CallFrame *frame = &vm->frames[vm->frame_count++];
     frame->closure = closure;
     frame->ip = closure->function->chunk.opcodes;
@@ -267,7 +314,10 @@ static InterpretResult run_vm(register VM *vm) {
     (frame.ip += 2, (uint16_t)(frame.ip[-2] << 8 | frame.ip[-1]))
 #define Read_Constant()                                                 \
     (frame.closure->function->chunk.constants[Read_Byte()])
+#define Read_Constant_16()                                              \
+    (frame.closure->function->chunk.constants[Read_Short()])
 #define Read_String() (As_String(Read_Constant()))
+#define Read_String_16() (As_String(Read_Constant_16()))
 
     // Stack Operations
 #define Pop()          (pop(vm))
@@ -296,11 +346,103 @@ static InterpretResult run_vm(register VM *vm) {
         Push(value_type(x op y));                            \
     } while (false)
 
+    // Globals Access
+#define Def_Global(name)                                     \
+    do {                                                     \
+        table_set(&vm->globals, Obj_Value(name), Peek(0));   \
+        Pop();                                               \
+    } while (false)
+
+#define Set_Global(name)                                     \
+    do {                                                     \
+        Value key = Obj_Value(name);                         \
+        if (table_set(&vm->globals, key, Peek(0))) {         \
+            table_remove(&vm->globals, key);                 \
+            Runtime_Error("unbound variable '%s'",           \
+                          name->chars);                      \
+            return INTERPRET_RUNTIME_ERROR;                  \
+        }                                                    \
+    } while (false)
+
+#define Get_Global(name)                                     \
+    do {                                                     \
+        Value value;                                         \
+        if (!table_get(&vm->globals, Obj_Value(name), &value)) {\
+            Runtime_Error("unbound variable '%s'",           \
+                          name->chars);                      \
+            return INTERPRET_RUNTIME_ERROR;                  \
+        }                                                    \
+        Push(value);                                         \
+    } while (false)
+
+    // Closure Creation, followed by the captured upvalues
+    // descriptors, 1-byte local flag and 2-bytes index.
+#define Make_Closure(function)                                          \
+    do {                                                                \
+        RavClosure *closure = object_closure(&vm->allocator, function); \
+        Push(Obj_Value(closure));                                       \
+                                                                        \
+        for (int i = 0; i < closure->upvalue_count; i++) {              \
+            uint8_t is_local = Read_Byte();                             \
+            uint16_t index = Read_Short();                              \
+                                                                        \
+            if (is_local) {                                             \
+                closure->upvalues[i] =                                  \
+                    capture_upvalue(vm, frame.slots + index);           \
+            } else {                                                    \
+                closure->upvalues[i] = frame.closure->upvalues[index];  \
+            }                                                           \
+        }                                                               \
+    } while (false)
+
+    // Array indexing, an in-range integral index takes the fast path,
+    // without floor, the other indexes are checked for the error cause.
+#define Array_Index(array, offset, index)                               \
+    do {                                                                \
+        if (!Is_Num(offset)) {                                          \
+            Runtime_Error("index an array with non-numeric type");      \
+            return INTERPRET_RUNTIME_ERROR;                             \
+        }                                                               \
+                                                                        \
+        double number = As_Num(offset);                                 \
+        if (number >= 0 && number < (double)(array)->count &&          \
+            (double)(size_t)number == number) {                         \
+            index = (size_t)number;                                     \
+        } else if (number != floor(number)) {                           \
+            Runtime_Error("array index should not have fraction part (%f)", number); \
+            return INTERPRET_RUNTIME_ERROR;                             \
+        } else {                                                        \
+            Runtime_Error(                                              \
+                "index out of bound (index: %lld, count: %llu)",        \
+                (int64_t)number,                                        \
+                (array)->count                                          \
+            );                                                          \
+            return INTERPRET_RUNTIME_ERROR;                             \
+        }                                                               \
+    } while (false)
+
+    // Map lookup for map patterns
+#define Map_Push_Element(key_value)                                     \
+    do {                                                                \
+        Value map_value = Pop();                                        \
+        assert(Is_Map(map_value));                                      \
+        assert(Is_String(key_value));                                   \
+                                                                        \
+        RavMap *map = As_Map(map_value);                                \
+                                                                        \
+        Value value;                                                    \
+        bool has_key = dict_get(&map->dict, key_value, &value);         \
+                                                                        \
+        vm->x = Bool_Value(has_key);                                    \
+        if (has_key) Push(value);                                       \
+    } while (false)
+
     Start() {
     Case(OP_PUSH_TRUE):  Push(Bool_Value(true));  Dispatch();
     Case(OP_PUSH_FALSE): Push(Bool_Value(false)); Dispatch();
     Case(OP_PUSH_NIL):   Push(Nil_Value);         Dispatch();
     Case(OP_PUSH_CONST): Push(Read_Constant());   Dispatch();
+    Case(OP_PUSH_CONST_16): Push(Read_Constant_16()); Dispatch();
 
     Case(OP_PUSH_X): {
         Push(vm->x);
@@ -325,6 +467,12 @@ static InterpretResult run_vm(register VM *vm) {
         Dispatch();
     }
 
+    Case(OP_POPN_16): {
+        uint16_t count = Read_Short();
+        vm->stack_top -= count;
+        Dispatch();
+    }
+
     Case(OP_ADD): Binary_OP(Num_Value, +); Dispatch();
     Case(OP_SUB): Binary_OP(Num_Value, -); Dispatch();
     Case(OP_MUL): Binary_OP(Num_Value, *); Dispatch();
@@ -354,7 +502,7 @@ static InterpretResult run_vm(register VM *vm) {
         Value y = Pop();
         Value x = Pop();
 
-        Push(Bool_Value(value_equal(x, y)));
+        Push(Bool_Value(is_equal(x, y)));
         Dispatch();
     }
 
@@ -362,7 +510,7 @@ static InterpretResult run_vm(register VM *vm) {
         Value y = Pop();
         Value x = Pop();
 
-        Push(Bool_Value(!value_equal(x, y)));
+        Push(Bool_Value(!is_equal(x, y)));
         Dispatch();
     }
 
@@ -373,33 +521,30 @@ static InterpretResult run_vm(register VM *vm) {
 
     Case(OP_NOT): Push(Bool_Value(is_falsy(Pop()))); Dispatch();
 
-    Case(OP_DEF_GLOBAL): {
+    Case(OP_DEF_GLOBAL):    Def_Global(Read_String());    Dispatch();
+    Case(OP_DEF_GLOBAL_16): Def_Global(Read_String_16()); Dispatch();
+
+    Case(OP_SET_GLOBAL): {
         RavString *name = Read_String();
-        table_set(&vm->globals, name, Peek(0));
-        Pop();
+        Set_Global(name);
         Dispatch();
     }
 
-    Case(OP_SET_GLOBAL): {
-        RavString *name = Read_String();
-        if (table_set(&vm->globals, name, Peek(0))) {
-            table_remove(&vm->globals, name);
-            Runtime_Error("unbound variable '%s'", name->chars);
-            return INTERPRET_RUNTIME_ERROR;
-        }
+    Case(OP_SET_GLOBAL_16): {
+        RavString *name = Read_String_16();
+        Set_Global(name);
         Dispatch();
     }
 
     Case(OP_GET_GLOBAL): {
         RavString *name = Read_String();
+        Get_Global(name);
+        Dispatch();
+    }
 
-        Value value;
-        if (table_get(&vm->globals, name, &value) == false) {
-            Runtime_Error("unbound variable '%s'", name->chars);
-            return INTERPRET_RUNTIME_ERROR;
-        }
-
-        Push(value);
+    Case(OP_GET_GLOBAL_16): {
+        RavString *name = Read_String_16();
+        Get_Global(name);
         Dispatch();
     }
 
@@ -423,6 +568,26 @@ static InterpretResult run_vm(register VM *vm) {
         Dispatch();
     }
 
+    Case(OP_SET_LOCAL_16): {
+        frame.slots[Read_Short()] = Peek(0);
+        Dispatch();
+    }
+
+    Case(OP_GET_LOCAL_16): {
+        Push(frame.slots[Read_Short()]);
+        Dispatch();
+    }
+
+    Case(OP_SET_UPVALUE_16): {
+        *frame.closure->upvalues[Read_Short()]->location = Peek(0);
+        Dispatch();
+    }
+
+    Case(OP_GET_UPVALUE_16): {
+        Push(*frame.closure->upvalues[Read_Short()]->location);
+        Dispatch();
+    }
+
     Case(OP_CALL): {
         int argument_count = Read_Byte();
         Value value = Peek(argument_count);
@@ -462,25 +627,110 @@ static InterpretResult run_vm(register VM *vm) {
         Dispatch();
     }
 
-    Case(OP_CLOSURE): {
-        RavFunction *function = As_Function(Read_Constant());
-        RavClosure *closure = object_closure(&vm->allocator, function);
-        Push(Obj_Value(closure));
+    Case(OP_ITER_INIT): {
+        // The subject is followed by its end, the resizes of maps and the
+        // state, the bounds of a range are reordered into [end, end, nil,
+        // start], the start is the state. The end of collections is their
+        // starting count, so the elements added while iterating are not
+        // visited.
+        if (Read_Byte()) {
+            Value start = Peek(1);
+            Value end = Peek(0);
+
+            if (!Is_Num(start) || !Is_Num(end)) {
+                Runtime_Error("range bounds must be numeric");
+                return INTERPRET_RUNTIME_ERROR;
+            }
+
+            vm->stack_top[-2] = end;
+            vm->stack_top[-1] = end;
+            Push(Nil_Value);
+            Push(start);
+            Dispatch();
+        }
+
+        Value subject = Peek(0);
+        if (Is_Array(subject)) {
+            Push(Num_Value(As_Array(subject)->count));
+            Push(Nil_Value);
+            Push(Num_Value(0));               // Element index
+        } else if (Is_Map(subject)) {
+            Dict *dict = &As_Map(subject)->dict;
+            Push(Num_Value(dict->used));
+            Push(Num_Value(dict->resizes));
+            Push(Num_Value(0));               // Entry index
+        } else if (Is_Pair(subject) || Is_Nil(subject)) {
+            Push(Nil_Value);
+            Push(Nil_Value);
+            Push(subject);                    // Current pair
+        } else {
+            Runtime_Error("iterate a non-collection type");
+            return INTERPRET_RUNTIME_ERROR;
+        }
+
+        Dispatch();
+    }
+
+    Case(OP_ITER_NEXT): {
+        // Push the next element and advance the state in its slot, or
+        // jump to the loop exit if the subject is exhausted.
+        uint16_t offset = Read_Short();
+        Value subject = Peek(3);
+        Value end = Peek(2);
+        Value *state = vm->stack_top - 1;
+
+        if (Is_Num(subject)) {
+            double current = As_Num(*state);
+            if (current < As_Num(end)) {
+                *state = Num_Value(current + 1);
+                Push(Num_Value(current));
+            } else {
+                frame.ip += offset;
+            }
+        } else if (Is_Array(subject)) {
+            RavArray *array = As_Array(subject);
+            size_t index = (size_t)As_Num(*state);
+
+            if (index < array->count && index < (size_t)As_Num(end)) {
+                *state = Num_Value(index + 1);
+                Push(object_array_get(array, index));
+            } else {
+                frame.ip += offset;
+            }
+        } else if (Is_Map(subject)) {
+            Dict *dict = &As_Map(subject)->dict;
+            if (dict->resizes != As_Num(Peek(1))) {
+                Runtime_Error("map resized during iteration");
+                return INTERPRET_RUNTIME_ERROR;
+            }
+
+            int index = (int)As_Num(*state);
+            int used = dict->used < As_Num(end) ? dict->used : (int)As_Num(end);
 
-        for (int i = 0; i < closure->upvalue_count; i++) {
-            uint8_t is_local = Read_Byte();
-            uint8_t index = Read_Byte();
+            while (index < used && Is_Nil(dict->entries[index].key)) {
+                index++;
+            }
 
-            if (is_local) {
-                closure->upvalues[i] = capture_upvalue(vm, frame.slots + index);
+            if (index < used) {
+                *state = Num_Value(index + 1);
+                Push(dict->entries[index].key);
             } else {
-                closure->upvalues[i] = frame.closure->upvalues[index];
+                frame.ip += offset;
             }
+        } else if (Is_Pair(*state)) {
+            RavPair *pair = As_Pair(*state);
+            *state = object_pair_tail(pair);
+            Push(pair->head);
+        } else {
+            frame.ip += offset;
         }
 
         Dispatch();
     }
 
+    Case(OP_CLOSURE):    Make_Closure(As_Function(Read_Constant()));    Dispatch();
+    Case(OP_CLOSURE_16): Make_Closure(As_Function(Read_Constant_16())); Dispatch();
+
     Case(OP_CLOSE_UPVALUE): {
         close_upvalues(vm, vm->stack_top - 1);
         Pop();
@@ -505,6 +755,20 @@ static InterpretResult run_vm(register VM *vm) {
         Dispatch();
     }
 
+    Case(OP_INTERPOLATE): {
+        // the parts are popped after building the string, as in OP_CONCAT
+        uint8_t count = Read_Byte();
+
+        StringBuffer buffer = string_buf_new(&vm->allocator);
+        string_buf_push_values(&buffer, vm->stack_top - count, count);
+        Value result = Obj_Value(string_buf_into(&buffer));
+
+        vm->stack_top -= count;
+        Push(result);
+
+        Dispatch();
+    }
+
     Case(OP_CONS): {
         // peek is used instead of pop, because of the possible GC round in `object_pair`
         // call could reclaim any of `tail` or `head` memory, if they were objects
@@ -519,6 +783,20 @@ static InterpretResult run_vm(register VM *vm) {
         Dispatch();
     }
 
+    Case(OP_LIST): {
+        // the heads and the tail are kept on the stack, while the chunks
+        // of the list are allocated
+        uint8_t count = Read_Byte();
+        Value *heads = vm->stack_top - count - 1;
+        object_list(&vm->allocator, heads, count);
+
+        Value list = heads[count];
+        vm->stack_top -= count + 1;
+        Push(list);
+
+        Dispatch();
+    }
+
     Case(OP_ARRAY_8): {
         size_t count = (size_t)Read_Byte();
         RavArray *array = object_array(&vm->allocator, vm->stack_top - count, count);
@@ -546,7 +824,7 @@ static InterpretResult run_vm(register VM *vm) {
             Value key = offset[i];
             Value value = offset[i+1];
 
-            table_set(&map->table, As_String(key), value);
+            dict_set(&map->dict, key, value);
         }
 
         vm->stack_top -= count;
@@ -564,7 +842,7 @@ static InterpretResult run_vm(register VM *vm) {
             Value key = offset[i];
             Value value = offset[i+1];
 
-            table_set(&map->table, As_String(key), value);
+            dict_set(&map->dict, key, value);
         }
 
         vm->stack_top -= count;
@@ -574,42 +852,33 @@ static InterpretResult run_vm(register VM *vm) {
     }
 
     Case(OP_SET_ELEMENT): {
-        Value value = Pop();
-        Value offset = Pop();
-        Value collection = Pop();
+        // slice keys are interned while the operands are still reachable
+        if (Is_Slice(Peek(1)) && Is_Map(Peek(2))) {
+            vm->stack_top[-2] = Obj_Value(object_slice_intern(&vm->allocator, As_Slice(Peek(1))));
+        }
+
+        // the operands are popped after the store, which may allocate
+        Value value = Peek(0);
+        Value offset = Peek(1);
+        Value collection = Peek(2);
 
         if (Is_Array(collection)) {
             RavArray *array = As_Array(collection);
-            if (!Is_Num(offset)) {
-                Runtime_Error("index an array with non-numeric type");
-                return INTERPRET_RUNTIME_ERROR;
-            }
-
-            double index = As_Num(offset);
-            if (index != floor(index)) {
-                Runtime_Error("array index should not have fraction part (%f)", index);
-                return INTERPRET_RUNTIME_ERROR;
-            }
-
-            if (index < 0.0f || index >= (double)array->count) {
-                Runtime_Error(
-                    "index out of bound (index: %lld, count: %llu)",
-                    (int64_t)index,
-                    array->count
-                );
-                return INTERPRET_RUNTIME_ERROR;
-            }
+            size_t index;
+            Array_Index(array, offset, index);
 
-            array->values[(size_t)index] = value;
+            object_array_set(&vm->allocator, array, index, value);
+            vm->stack_top -= 3;
             Push(value);
         } else if (Is_Map(collection)) {
-            if (!Is_String(offset)) {
-                Runtime_Error("index a map with non-string type");
+            if (Is_Nil(offset)) {
+                Runtime_Error("index a map with nil");
                 return INTERPRET_RUNTIME_ERROR;
             }
 
             RavMap *map = As_Map(collection);
-            table_set(&map->table, As_String(offset), value);
+            dict_set(&map->dict, offset, value);
+            vm->stack_top -= 3;
             Push(value);
         } else {
             Runtime_Error("index a non-collection type");
@@ -625,37 +894,16 @@ static InterpretResult run_vm(register VM *vm) {
 
         if (Is_Array(collection)) {
             RavArray *array = As_Array(collection);
-            if (!Is_Num(offset)) {
-                Runtime_Error("index an array with non-numeric type");
-                return INTERPRET_RUNTIME_ERROR;
-            }
-
-            double index = As_Num(offset);
-            if (index != floor(index)) {
-                Runtime_Error("array index should not have fraction part (%f)", index);
-                return INTERPRET_RUNTIME_ERROR;
-            }
-
-            if (index < 0.0f || index >= (double)array->count) {
-                Runtime_Error(
-                    "index out of bound (index: %lld, count: %llu)",
-                    (int64_t)index,
-                    array->count
-                );
-                return INTERPRET_RUNTIME_ERROR;
-            }
+            size_t index;
+            Array_Index(array, offset, index);
 
-            Push(array->values[(size_t)index]);
+            Push(object_array_get(array, index));
         } else if (Is_Map(collection)) {
-            if (!Is_String(offset)) {
-                Runtime_Error("index a map with non-string type");
-                return INTERPRET_RUNTIME_ERROR;
-            }
-
             RavMap *map = As_Map(collection);
+            Value key = lookup_key(vm, offset);
             Value value = Nil_Value;
-            RavString* key = As_String(offset);
-            table_get(&map->table, key, &value);
+
+            if (!Is_Nil(key)) dict_get(&map->dict, key, &value);
             Push(value);
         } else {
             Runtime_Error("index a non-collection type");
@@ -675,7 +923,7 @@ static InterpretResult run_vm(register VM *vm) {
     Case(OP_CDR): {
         Value value = Pop();
         assert(Is_Pair(value));
-        Push(As_Pair(value)->tail);
+        Push(object_pair_tail(As_Pair(value)));
         Dispatch();
     }
 
@@ -694,26 +942,19 @@ static InterpretResult run_vm(register VM *vm) {
         RavArray *array = As_Array(value);
 
         assert(index < array->count);
-        Push(array->values[(size_t)index]);
+        Push(object_array_get(array, index));
         Dispatch();
     }
 
     Case(OP_MAP_PUSH_ELEMENT): {
-        Value map_value = Pop();
-        assert(Is_Map(map_value));
-
         Value key_value = Read_Constant();
-        assert(Is_String(key_value));
-
-        RavMap *map = As_Map(map_value);
-        RavString *key = As_String(key_value);
-
-        Value value;
-        bool has_key = table_get(&map->table, key, &value);
-
-        vm->x = Bool_Value(has_key);
-        if (has_key) Push(value);
+        Map_Push_Element(key_value);
+        Dispatch();
+    }
 
+    Case(OP_MAP_PUSH_ELEMENT_16): {
+        Value key_value = Read_Constant_16();
+        Map_Push_Element(key_value);
         Dispatch();
     }
 
@@ -744,6 +985,11 @@ static InterpretResult run_vm(register VM *vm) {
         vm->stack_top = frame.slots;
         Push(result);
 
+        // back to the native function which called the returning one
+        if (vm->frame_count == vm->frame_base) {
+            return INTERPRET_OK;
+        }
+
         frame = vm->frames[vm->frame_count - 1];
         Dispatch();
     }
@@ -759,6 +1005,12 @@ static InterpretResult run_vm(register VM *vm) {
     assert(!"invalid instruction");
     return INTERPRET_RUNTIME_ERROR; // For warnings
 
+#undef Map_Push_Element
+#undef Array_Index
+#undef Make_Closure
+#undef Get_Global
+#undef Set_Global
+#undef Def_Global
 #undef Binary_OP
 #undef Runtime_Error
 #undef Save_Frame
@@ -766,7 +1018,9 @@ static InterpretResult run_vm(register VM *vm) {
 #undef Pop
 #undef Push
 #undef Read_Short
+#undef Read_String_16
 #undef Read_String
+#undef Read_Constant_16
 #undef Read_Constant
 #undef Read_Byte
 #undef Dispatch
@@ -775,52 +1029,125 @@ static InterpretResult run_vm(register VM *vm) {
 #undef Log_Execution
 }
 
+/// Source Files
+
+// Read the whole file at the given path into a null-terminated string.
+// Return NULL on failure, with errno set to the failure reason.
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    rewind(file);
+
+    char *source = (char *)malloc(size + 1);
+    if (source == NULL) {
+        fclose(file);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t bytes_read = fread(source, sizeof (char), size, file);
+    if (bytes_read < size || ferror(file)) {
+        fclose(file);
+        free(source);
+        return NULL;
+    }
+
+    fclose(file);
+    source[size] = '\0';
+    return source;
+}
+
+// Compile the source file at the given path, or load its bytecode cache
+// if it's up to date with the source. On failure return NULL, and set
+// `error` to the reading error description, or to NULL if the source
+// has compilation errors. The GC must be disabled by the caller.
+static RavFunction *load_file(VM *vm, const char *path, const char **error) {
+    *error = NULL;
+
+    RavFunction *function = bytecode_load(vm, path);
+    if (function != NULL) {
+        return function;
+    }
+
+    char *source = read_file(path);
+    if (source == NULL) {
+        *error = strerror(errno);
+        return NULL;
+    }
+
+    function = compile(vm, source, path);
+    if (function != NULL) {
+        bytecode_save(function, path);
+    }
+
+    free(source);
+    return function;
+}
+
 /// Native Functions
 
 static void register_natives(VM*);
 
-static bool native_import(VM *vm, Value *arguments, size_t count, Value *result) {
-    MAYBE_UNUSED(count);
+// Return the string of a string or slice argument, slices are interned,
+// so the characters are null-terminated. Return NULL for other values.
+static RavString *text_argument(VM *vm, Value argument) {
+    if (Is_String(argument)) return As_String(argument);
+    if (Is_Slice(argument)) return object_slice_intern(&vm->allocator, As_Slice(argument));
+    return NULL;
+}
 
-    Value argument = arguments[0];
-    if (Is_String(argument) == false) {
-        runtime_error(vm, "`import` expected string, got %s", type_repr(argument));
+// Check that the argument is callable, or report an error for the native
+// function, about its argument at the given position.
+static bool function_argument(VM *vm, const char *native, const char *position, Value argument) {
+    if (Is_Closure(argument) || Is_CFunction(argument)) {
+        return true;
+    }
+
+    runtime_error(vm, "`%s` expected function as %s argument, got %s", native, position, type_repr(argument));
+    return false;
+}
+
+// Execute the module at the given path, or return its cached exports if it
+// was already imported, unless `reload` is set. `native` is the name of the
+// calling native function, for error reporting. While a module runs, its
+// function is cached in place of its exports, to report cyclic imports,
+// functions are never values otherwise, only closures are.
+static bool import_module(VM *vm, const char *native, Value argument, bool reload, Value *result) {
+    RavString *path_string = text_argument(vm, argument);
+    if (path_string == NULL) {
+        runtime_error(vm, "`%s` expected string, got %s", native, type_repr(argument));
         return false;
     }
 
-    // read the file
-    const char *path = As_String(argument)->chars;
-    char *source = NULL;
-    {
-        FILE *file = fopen(path, "rb");
-        if (file == NULL) {
-            runtime_error(vm, "`import` error reading '%s' (%s)", path, strerror(errno));
-            return false;
-        }
+    const char *path = path_string->chars;
 
-        fseek(file, 0L, SEEK_END);
-        size_t size = ftell(file);
-        rewind(file);
+    char *canonical = realpath(path, NULL);
+    if (canonical == NULL) {
+        runtime_error(vm, "`%s` error reading '%s' (%s)", native, path, strerror(errno));
+        return false;
+    }
 
-        source = (char *)malloc(size + 1);
-        if (source == NULL) {
-            runtime_error(vm, "`import` error reading '%s' (out of memory)", path);
-            fclose(file);
-            return false;
-        }
+    RavString *key = object_string(&vm->allocator, canonical, strlen(canonical));
+    free(canonical);
 
-        size_t bytes_read = fread(source, sizeof (char), size, file);
-        if (bytes_read < size || ferror(file)) {
-            runtime_error(vm, "`import` error reading '%s' (%s)", path, strerror(errno));
-            fclose(file);
-            free(source);
-            return false;
-        }
-        fclose(file);
-        source[size] = '\0';
+    Value cached = Nil_Value;
+    bool imported = table_get(&vm->modules, Obj_Value(key), &cached);
+    if (imported && Is_Function(cached)) {
+        runtime_error(vm, "`%s` cyclic import of '%s'", native, path);
+        return false;
     }
 
-    // execute the source
+    if (imported && !reload) {
+        *result = cached;
+        return true;
+    }
+
+    // execute the module
     Value exported = Nil_Value;
     {
         VM sandbox = {0};
@@ -828,51 +1155,82 @@ static bool native_import(VM *vm, Value *arguments, size_t count, Value *result)
         sandbox.allocator = vm->allocator;
         sandbox.path = path;
         sandbox.x = Nil_Value;
+        sandbox.modules = vm->modules;
+        sandbox.output = vm->output;
+        sandbox.output_line = vm->output_line;
 
         reset_stack(&sandbox);
         table_init(&sandbox.globals);
         register_natives(&sandbox);
 
-        // since the current context's object are not reachable to the sandbox they need
-        // to be hided, so they are not freed in the `interpret` call by the GC, this is
-        // achieved by marking the beginning of the current objects list to be the end of
-        // the sandbox object list
-        sandbox.allocator.objects_end = sandbox.allocator.objects;
+        // since the current context's object are not reachable to the sandbox, they
+        // would be freed by a GC round of the sandbox, so it runs with the GC disabled
+        // (set by `register_natives`)
 
-        RavFunction *function = compile(&sandbox, source, path);
-        if (function == NULL) {
-            free(source);
-            return false;
-        }
+        const char *error = NULL;
+        InterpretResult interpreted = INTERPRET_COMPILE_ERROR;
 
-        RavClosure *closure = object_closure(&sandbox.allocator, function);
-        push(&sandbox, Obj_Value(closure));
-        push_frame(&sandbox, closure, 0);
+        RavFunction *function = load_file(&sandbox, path, &error);
+        if (function != NULL) {
+            table_set(&sandbox.modules, Obj_Value(key), Obj_Value(function));
 
-        // TODO: errors should dump the current context stack
-        InterpretResult result = run_vm(&sandbox);
-        if (result != INTERPRET_OK) {
-            free(source);
-            return false;
+            RavClosure *closure = object_closure(&sandbox.allocator, function);
+            push(&sandbox, Obj_Value(closure));
+            push_frame(&sandbox, closure, 0);
+
+            // TODO: errors should dump the current context stack
+            interpreted = run_vm(&sandbox);
         }
 
-        // reset allocator state to the current context
-        sandbox.allocator.objects_end = NULL;
+        // reset allocator state to the current context, the sandbox
+        // runs with the GC disabled (set by `register_natives`)
+        bool gc_off = vm->allocator.gc_off;
         vm->allocator = sandbox.allocator;
+        vm->allocator.gc_off = gc_off;
+
+        // nested imports may have grown the modules cache, and the
+        // module may have written to the output
+        vm->modules = sandbox.modules;
+        vm->output = sandbox.output;
 
         // obtian the exported value from the X register
         exported = sandbox.x;
 
         // clear the sandbox resources
         table_free(&sandbox.globals);
+
+        if (error != NULL) {
+            runtime_error(vm, "`%s` error reading '%s' (%s)", native, path, error);
+            return false;
+        }
+
+        // failed modules are cached as before they ran
+        if (interpreted != INTERPRET_OK) {
+            if (imported) {
+                table_set(&vm->modules, Obj_Value(key), cached);
+            } else {
+                table_remove(&vm->modules, Obj_Value(key));
+            }
+            return false;
+        }
     }
 
-    *result = exported;
+    table_set(&vm->modules, Obj_Value(key), exported);
 
-    free(source);
+    *result = exported;
     return true;
 }
 
+static bool native_import(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+    return import_module(vm, "import", arguments[0], false, result);
+}
+
+static bool native_reload(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+    return import_module(vm, "reload", arguments[0], true, result);
+}
+
 static bool native_assert(VM *vm, Value *arguments, size_t count, Value *result) {
     Value expression = arguments[0];
     Value message = Nil_Value;
@@ -881,7 +1239,7 @@ static bool native_assert(VM *vm, Value *arguments, size_t count, Value *result)
     if (count == 2) {
         message = arguments[1];
 
-        if (Is_String(message) == false) {
+        if (Is_Text(message) == false) {
             runtime_error(vm, "`assert` expected string as second argument, got %s", type_repr(message));
             return false;
         }
@@ -889,7 +1247,9 @@ static bool native_assert(VM *vm, Value *arguments, size_t count, Value *result)
 
     if (is_falsy(expression)) {
         if (count == 2) {
-            runtime_error(vm, "assertion failed: %s", As_String(message)->chars);
+            int length;
+            const char *chars = object_text(message, &length);
+            runtime_error(vm, "assertion failed: %.*s", length, chars);
         } else {
             runtime_error(vm, "assertion failed");
         }
@@ -900,26 +1260,41 @@ static bool native_assert(VM *vm, Value *arguments, size_t count, Value *result)
     return true;
 }
 
+// Apply the flush policy after writing to the output.
+static void output_written(VM *vm, bool new_line) {
+#ifdef DEBUG_TRACE_EXECUTION
+    // keep the output in order with the execution trace
+    new_line = true;
+#endif
+
+    if (vm->output.count >= OUTPUT_BUFFER_SIZE || (new_line && vm->output_line)) {
+        vm_flush(vm);
+    }
+}
+
 static bool native_print(VM *vm, Value *arguments, size_t count, Value *result) {
-    MAYBE_UNUSED(vm);
+    bool new_line = false;
 
     for (size_t i = 0; i < count; ++i) {
-        value_print(arguments[i]);
-        putchar(' ');
+        int before = vm->output.count;
+        string_buf_push(&vm->output, arguments[i]);
+        string_buf_write(&vm->output, " ", 1);
+
+        new_line = new_line || memchr(vm->output.buffer + before, '\n', vm->output.count - before);
     }
+    output_written(vm, new_line);
 
     *result = Nil_Value;
     return true;
 }
 
 static bool native_println(VM *vm, Value *arguments, size_t count, Value *result) {
-    MAYBE_UNUSED(vm);
-
     for (size_t i = 0; i < count; ++i) {
-        value_print(arguments[i]);
-        putchar(' ');
+        string_buf_push(&vm->output, arguments[i]);
+        string_buf_write(&vm->output, " ", 1);
     }
-    putchar('\n');
+    string_buf_write(&vm->output, "\n", 1);
+    output_written(vm, true);
 
     *result = Nil_Value;
     return true;
@@ -929,8 +1304,10 @@ static bool native_len(VM *vm, Value *arguments, size_t count, Value *result) {
     MAYBE_UNUSED(count);
 
     Value argument = arguments[0];
-    if (Is_String(argument)) {
-        *result = Num_Value(As_String(argument)->length);
+    if (Is_Text(argument)) {
+        int length;
+        object_text(argument, &length);
+        *result = Num_Value(length);
         return true;
     }
     if (Is_Array(argument)) {
@@ -938,7 +1315,7 @@ static bool native_len(VM *vm, Value *arguments, size_t count, Value *result) {
         return true;
     }
     if (Is_Map(argument)) {
-        *result = Num_Value(As_Map(argument)->table.count);
+        *result = Num_Value(As_Map(argument)->dict.count);
         return true;
     }
 
@@ -946,96 +1323,994 @@ static bool native_len(VM *vm, Value *arguments, size_t count, Value *result) {
     return false;
 }
 
-// Array Native Functions
+// String Native Functions
 
-static bool native_push(VM *vm, Value *arguments, size_t count, Value *result) {
-    Value argument = arguments[0];
-    if (Is_Array(argument) == false) {
-        runtime_error(vm, "`push` expected array as firt argument, got %s", type_repr(argument));
+// Check that the argument is an integer in the range [0, limit].
+static bool index_argument(Value argument, int limit, int *index) {
+    if (!Is_Num(argument)) {
         return false;
     }
 
-    RavArray *array = As_Array(argument);
-    for (size_t i = 1; i < count; ++i) {
-        // Grow array memory, if needed
-        if (array->count == array->capacity) {
-            size_t old_cap = array->capacity;
-            size_t new_cap = Grow_Capacity(old_cap);
-            array->capacity = new_cap;
-            array->values = Grow_Array(&vm->allocator, array->values, Value, old_cap, new_cap);
-        }
-        array->values[array->count++] = arguments[i];
+    double number = As_Num(argument);
+    if (number != floor(number) || number < 0 || number > limit) {
+        return false;
     }
 
-    *result = argument;
+    *index = (int)number;
     return true;
 }
 
-static bool native_pop(VM *vm, Value *arguments, size_t count, Value *result) {
-    MAYBE_UNUSED(count);
+static bool slice_array(VM *vm, Value *arguments, size_t count, Value *result);
 
+static bool native_slice(VM *vm, Value *arguments, size_t count, Value *result) {
     Value argument = arguments[0];
-    if (Is_Array(argument) == false) {
-        runtime_error(vm, "`pop` expected array, got %s", type_repr(argument));
-        return false;
+    if (Is_Array(argument)) {
+        return slice_array(vm, arguments, count, result);
     }
 
-    RavArray *array = As_Array(argument);
-    if (array->count == 0) {
-        runtime_error(vm, "`pop` on an empty array");
+    if (Is_Text(argument) == false) {
+        runtime_error(vm, "`slice` expected string or array as first argument, got %s", type_repr(argument));
         return false;
     }
 
-    *result = array->values[--array->count];
-    return true;
-}
-
-// Map Native Functions
-
-static bool native_insert(VM *vm, Value *arguments, size_t count, Value *result) {
-    MAYBE_UNUSED(count);
+    int length;
+    const char *chars = object_text(argument, &length);
 
-    Value argument1 = arguments[0];
-    if (Is_Map(argument1) == false) {
-        runtime_error(vm, "`insert` expected map as first argument, got %s", type_repr(argument1));
+    int start;
+    if (!index_argument(arguments[1], length, &start)) {
+        runtime_error(vm, "`slice` expected index in [0, %d] as second argument", length);
         return false;
     }
-    RavMap *map = As_Map(argument1);
 
-    Value argument2 = arguments[1];
-    if (Is_String(argument2) == false) {
-        runtime_error(vm, "`insert` expected string as second argument, got %s", type_repr(argument2));
+    int end = length;
+    if (count == 3 && !index_argument(arguments[2], length, &end)) {
+        runtime_error(vm, "`slice` expected index in [0, %d] as third argument", length);
         return false;
     }
-    RavString *key = As_String(argument2);
 
-    Value value = arguments[2];
-    table_set(&map->table, key, value);
-    *result = value;
+    if (end < start) {
+        end = start;
+    }
+
+    // the whole string is its own slice
+    if (Is_String(argument) && start == 0 && end == length) {
+        *result = argument;
+        return true;
+    }
+
+    *result = Obj_Value(object_slice(&vm->allocator, As_Obj(argument), chars + start, end - start));
     return true;
 }
 
-static bool native_remove(VM *vm, Value *arguments, size_t count, Value *result) {
-    MAYBE_UNUSED(count);
+// Return the first occurrence of the needle in the characters, or NULL.
+static const char *find_text(const char *chars, size_t length, const char *needle, size_t needle_length) {
+    const char *end = chars + length;
 
-    Value argument1 = arguments[0];
-    if (Is_Map(argument1) == false) {
-        runtime_error(vm, "`remove` expected map as firt argument, got %s", type_repr(argument1));
+    while ((size_t)(end - chars) >= needle_length) {
+        chars = memchr(chars, needle[0], end - chars - needle_length + 1);
+        if (chars == NULL) {
+            return NULL;
+        }
+        if (memcmp(chars + 1, needle + 1, needle_length - 1) == 0) {
+            return chars;
+        }
+        chars++;
+    }
+
+    return NULL;
+}
+
+static bool native_split(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Value argument = arguments[0];
+    if (Is_Text(argument) == false) {
+        runtime_error(vm, "`split` expected string as first argument, got %s", type_repr(argument));
+        return false;
+    }
+
+    Value separator = arguments[1];
+    int separator_length = 0;
+    if (Is_Text(separator)) object_text(separator, &separator_length);
+
+    if (separator_length == 0) {
+        runtime_error(vm, "`split` expected non-empty string as second argument, got %s", type_repr(separator));
+        return false;
+    }
+
+    int length;
+    const char *chars = object_text(argument, &length);
+    const char *separator_chars = object_text(separator, &separator_length);
+    const char *end = chars + length;
+
+    // the array and each slice are kept on the stack, while allocating
+    RavArray *array = object_array(&vm->allocator, NULL, 0);
+    push(vm, Obj_Value(array));
+
+    for (const char *field = chars;;) {
+        const char *next = find_text(field, end - field, separator_chars, separator_length);
+        const char *field_end = next ? next : end;
+
+        RavSlice *slice = object_slice(&vm->allocator, As_Obj(argument), field, field_end - field);
+        push(vm, Obj_Value(slice));
+        object_array_push(&vm->allocator, array, Obj_Value(slice));
+        pop(vm);
+
+        if (next == NULL) {
+            break;
+        }
+        field = next + separator_length;
+    }
+
+    pop(vm);
+    *result = Obj_Value(array);
+    return true;
+}
+
+// Array Native Functions
+
+static bool native_push(VM *vm, Value *arguments, size_t count, Value *result) {
+    Value argument = arguments[0];
+    if (Is_Array(argument) == false) {
+        runtime_error(vm, "`push` expected array as firt argument, got %s", type_repr(argument));
+        return false;
+    }
+
+    RavArray *array = As_Array(argument);
+    for (size_t i = 1; i < count; ++i) {
+        object_array_push(&vm->allocator, array, arguments[i]);
+    }
+
+    *result = argument;
+    return true;
+}
+
+static bool native_pop(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Value argument = arguments[0];
+    if (Is_Array(argument) == false) {
+        runtime_error(vm, "`pop` expected array, got %s", type_repr(argument));
+        return false;
+    }
+
+    RavArray *array = As_Array(argument);
+    if (array->count == 0) {
+        runtime_error(vm, "`pop` on an empty array");
+        return false;
+    }
+
+    *result = object_array_get(array, --array->count);
+    return true;
+}
+
+// Return a new array of the elements in [start, end).
+static RavArray *copy_array(VM *vm, RavArray *array, size_t start, size_t end) {
+    if (!array->packed) {
+        return object_array(&vm->allocator, array->values + start, end - start);
+    }
+
+    RavArray *copy = object_array_packed(&vm->allocator, end - start);
+    if (end > start) {
+        memcpy(copy->numbers, array->numbers + start, (end - start) * sizeof (double));
+    }
+    return copy;
+}
+
+static bool slice_array(VM *vm, Value *arguments, size_t count, Value *result) {
+    RavArray *array = As_Array(arguments[0]);
+    int length = array->count > INT32_MAX ? INT32_MAX : (int)array->count;
+
+    int start;
+    if (!index_argument(arguments[1], length, &start)) {
+        runtime_error(vm, "`slice` expected index in [0, %d] as second argument", length);
+        return false;
+    }
+
+    int end = length;
+    if (count == 3 && !index_argument(arguments[2], length, &end)) {
+        runtime_error(vm, "`slice` expected index in [0, %d] as third argument", length);
+        return false;
+    }
+
+    if (end < start) {
+        end = start;
+    }
+
+    *result = Obj_Value(copy_array(vm, array, start, end));
+    return true;
+}
+
+static bool native_copy(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Value argument = arguments[0];
+    if (Is_Array(argument) == false) {
+        runtime_error(vm, "`copy` expected array, got %s", type_repr(argument));
+        return false;
+    }
+
+    RavArray *array = As_Array(argument);
+    *result = Obj_Value(copy_array(vm, array, 0, array->count));
+    return true;
+}
+
+static bool native_fill(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Value argument = arguments[0];
+    if (Is_Array(argument) == false) {
+        runtime_error(vm, "`fill` expected array as first argument, got %s", type_repr(argument));
+        return false;
+    }
+
+    RavArray *array = As_Array(argument);
+    Value value = arguments[1];
+
+    if (array->packed && !Is_Num(value)) {
+        object_array_unpack(&vm->allocator, array);
+    }
+
+    if (array->packed) {
+        vector_fill(array->numbers, array->count, As_Num(value));
+    } else {
+        for (size_t i = 0; i < array->count; i++) {
+            array->values[i] = value;
+        }
+    }
+
+    *result = argument;
+    return true;
+}
+
+typedef struct {
+    VM *vm;
+    Value comparator;
+    bool failed;
+} Comparison;
+
+// Order by the comparator, which returns true if its first argument is
+// ordered before its second, after a failing call the order is ignored.
+static bool comparator_less(void *context, Value x, Value y) {
+    Comparison *comparison = context;
+    if (comparison->failed) {
+        return false;
+    }
+
+    Value arguments[2] = { x, y };
+    Value result;
+    if (!vm_call(comparison->vm, comparison->comparator, 2, arguments, &result)) {
+        comparison->failed = true;
+        return false;
+    }
+
+    return !is_falsy(result);
+}
+
+static bool native_sort(VM *vm, Value *arguments, size_t count, Value *result) {
+    Value argument = arguments[0];
+    if (Is_Array(argument) == false) {
+        runtime_error(vm, "`sort` expected array as first argument, got %s", type_repr(argument));
+        return false;
+    }
+
+    RavArray *array = As_Array(argument);
+    *result = argument;
+
+    size_t index;
+    if (count == 1) {
+        if (array->count < 2) {
+            return true;
+        }
+        if (object_array_pack(&vm->allocator, array, &index)) {
+            sort_numbers(array->numbers, array->count);
+            return true;
+        }
+
+        if (Is_Text(array->values[0])) {
+            for (index = 1; index < array->count && Is_Text(array->values[index]); index++);
+            if (index == array->count) {
+                sort_texts(array->values, array->count);
+                return true;
+            }
+        }
+
+        // the first element tells which of the sortable types is expected
+        Value first = array->values[0];
+        if (Is_Num(first) || Is_Text(first)) {
+            runtime_error(vm, "`sort` array mixes %s with %s at index %zu",
+                          Is_Num(first) ? "numbers" : "strings",
+                          type_repr(array->values[index]), index);
+        } else {
+            runtime_error(vm, "`sort` expected array of numbers or strings, got %s at index %zu",
+                          type_repr(first), index);
+        }
+        return false;
+    }
+
+    Value comparator = arguments[1];
+    if (!function_argument(vm, "sort", "second", comparator)) {
+        return false;
+    }
+
+    // a copy is sorted, out of the reach of the comparator, which may
+    // modify the array, and its elements replace the array ones after
+    RavArray *copy = copy_array(vm, array, 0, array->count);
+    push(vm, Obj_Value(copy));
+    if (copy->packed) {
+        object_array_unpack(&vm->allocator, copy);
+    }
+
+    Comparison comparison = { vm, comparator, false };
+    sort_values(copy->values, copy->count, comparator_less, &comparison);
+    if (comparison.failed) {
+        return false;
+    }
+
+    RavArray swapped = *array;
+    array->values = copy->values;
+    array->count = copy->count;
+    array->capacity = copy->capacity;
+    array->packed = false;
+    copy->values = swapped.values;
+    copy->count = swapped.count;
+    copy->capacity = swapped.capacity;
+    copy->packed = swapped.packed;
+
+    if (swapped.packed) {
+        object_array_pack(&vm->allocator, array, &index);
+    }
+
+    pop(vm);
+    return true;
+}
+
+// Numeric Array Native Functions
+
+// Return the array argument packed, or NULL if it's not an array of numbers.
+static RavArray *numbers_argument(VM *vm, const char *native, const char *position, Value argument) {
+    if (Is_Array(argument) == false) {
+        runtime_error(vm, "`%s` expected array of numbers%s, got %s", native, position, type_repr(argument));
+        return NULL;
+    }
+
+    RavArray *array = As_Array(argument);
+    size_t index;
+    if (!object_array_pack(&vm->allocator, array, &index)) {
+        runtime_error(vm, "`%s` expected array of numbers%s, got %s at index %zu",
+                      native, position, type_repr(array->values[index]), index);
+        return NULL;
+    }
+
+    return array;
+}
+
+static bool native_sum(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavArray *array = numbers_argument(vm, "sum", "", arguments[0]);
+    if (array == NULL) {
+        return false;
+    }
+
+    *result = Num_Value(vector_sum(array->numbers, array->count));
+    return true;
+}
+
+static bool native_min(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavArray *array = numbers_argument(vm, "min", "", arguments[0]);
+    if (array == NULL) {
+        return false;
+    }
+
+    *result = array->count == 0 ? Nil_Value : Num_Value(vector_min(array->numbers, array->count));
+    return true;
+}
+
+static bool native_max(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavArray *array = numbers_argument(vm, "max", "", arguments[0]);
+    if (array == NULL) {
+        return false;
+    }
+
+    *result = array->count == 0 ? Nil_Value : Num_Value(vector_max(array->numbers, array->count));
+    return true;
+}
+
+static bool native_dot(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavArray *array1 = numbers_argument(vm, "dot", " as first argument", arguments[0]);
+    if (array1 == NULL) {
+        return false;
+    }
+
+    RavArray *array2 = numbers_argument(vm, "dot", " as second argument", arguments[1]);
+    if (array2 == NULL) {
+        return false;
+    }
+
+    if (array1->count != array2->count) {
+        runtime_error(vm, "`dot` expected arrays of the same length, got %zu and %zu",
+                      array1->count, array2->count);
+        return false;
+    }
+
+    *result = Num_Value(vector_dot(array1->numbers, array2->numbers, array1->count));
+    return true;
+}
+
+static bool native_scale(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavArray *array = numbers_argument(vm, "scale", " as first argument", arguments[0]);
+    if (array == NULL) {
+        return false;
+    }
+
+    Value factor = arguments[1];
+    if (Is_Num(factor) == false) {
+        runtime_error(vm, "`scale` expected number as second argument, got %s", type_repr(factor));
+        return false;
+    }
+
+    RavArray *scaled = object_array_packed(&vm->allocator, array->count);
+    vector_scale(scaled->numbers, array->numbers, array->count, As_Num(factor));
+
+    *result = Obj_Value(scaled);
+    return true;
+}
+
+// Pair Native Functions
+
+static bool native_hcons(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    // slices are shared as their interned strings, which are kept on the
+    // stack while the pair is allocated
+    for (int i = 0; i < 2; i++) {
+        if (Is_Slice(arguments[i])) {
+            arguments[i] = Obj_Value(object_slice_intern(&vm->allocator, As_Slice(arguments[i])));
+        }
+    }
+
+    *result = Obj_Value(object_pair_consed(&vm->allocator, arguments[0], arguments[1]));
+    return true;
+}
+
+// Map Native Functions
+
+static bool native_insert(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Value argument1 = arguments[0];
+    if (Is_Map(argument1) == false) {
+        runtime_error(vm, "`insert` expected map as first argument, got %s", type_repr(argument1));
+        return false;
+    }
+    RavMap *map = As_Map(argument1);
+
+    Value key = arguments[1];
+    if (Is_Nil(key)) {
+        runtime_error(vm, "`insert` expected key as second argument, got nil");
+        return false;
+    }
+    if (Is_Slice(key)) {
+        key = Obj_Value(object_slice_intern(&vm->allocator, As_Slice(key)));
+    }
+
+    Value value = arguments[2];
+    dict_set(&map->dict, key, value);
+    *result = value;
+    return true;
+}
+
+static bool native_remove(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Value argument1 = arguments[0];
+    if (Is_Map(argument1) == false) {
+        runtime_error(vm, "`remove` expected map as firt argument, got %s", type_repr(argument1));
+        return false;
+    }
+    RavMap *map = As_Map(argument1);
+
+    Value key = lookup_key(vm, arguments[1]);
+    if (Is_Nil(key)) {
+        *result = Nil_Value;
+        return true;
+    }
+
+    *result = dict_remove(&map->dict, key);
+    return true;
+}
+
+// Higher-Order Native Functions
+
+// Iteration over the elements of arrays and lists, and the entries of
+// maps, the collection may be modified by the called functions, so its
+// state is read again on every step, but elements appended to arrays
+// aren't visited. Maps entries can't be moved while iterating them.
+typedef struct {
+    Value collection;
+    const char *native;
+    size_t end;  // Count of arrays elements and maps entries at the start
+    int index;   // Next index of arrays elements and maps entries
+    int resizes; // Resizes of maps at the start
+    Value list;  // Remaining pairs of lists
+} Cursor;
+
+static bool collection_argument(VM *vm, const char *native, Value argument, Cursor *cursor) {
+    if (!Is_Array(argument) && !Is_Map(argument) && !Is_Pair(argument) && !Is_Nil(argument)) {
+        runtime_error(vm, "`%s` expected collection as first argument, got %s", native, type_repr(argument));
+        return false;
+    }
+
+    size_t end = Is_Array(argument) ? As_Array(argument)->count
+               : Is_Map(argument) ? (size_t)As_Map(argument)->dict.used
+               : 0;
+    int resizes = Is_Map(argument) ? As_Map(argument)->dict.resizes : 0;
+    *cursor = (Cursor){ argument, native, end, 0, resizes, argument };
+    return true;
+}
+
+// Set the next element, and its key for maps, return false at the end.
+static bool cursor_next(Cursor *cursor, Value *key, Value *element) {
+    Value collection = cursor->collection;
+
+    if (Is_Array(collection)) {
+        RavArray *array = As_Array(collection);
+        if ((size_t)cursor->index >= array->count || (size_t)cursor->index >= cursor->end) {
+            return false;
+        }
+
+        *element = object_array_get(array, cursor->index++);
+        return true;
+    }
+
+    if (Is_Map(collection)) {
+        Dict *dict = &As_Map(collection)->dict;
+        while (cursor->index < dict->used && (size_t)cursor->index < cursor->end &&
+               Is_Nil(dict->entries[cursor->index].key)) {
+            cursor->index++;
+        }
+        if (cursor->index >= dict->used || (size_t)cursor->index >= cursor->end) {
+            return false;
+        }
+
+        Entry *entry = &dict->entries[cursor->index++];
+        *key = entry->key;
+        *element = entry->value;
+        return true;
+    }
+
+    if (Is_Pair(cursor->list)) {
+        RavPair *pair = As_Pair(cursor->list);
+        *element = pair->head;
+        cursor->list = object_pair_tail(pair);
+        return true;
+    }
+
+    return false;
+}
+
+// Call the function with the element, or with the key and the value of
+// maps entries, preceded by the accumulator if it's not NULL. It's an error
+// if the function resized the iterated map.
+static bool call_element(VM *vm, Value function, Cursor *cursor, Value *accumulator,
+                         Value key, Value element, Value *result) {
+    Value arguments[3];
+    int count = 0;
+
+    if (accumulator != NULL) arguments[count++] = *accumulator;
+    if (Is_Map(cursor->collection)) arguments[count++] = key;
+    arguments[count++] = element;
+
+    if (!vm_call(vm, function, count, arguments, result)) {
         return false;
     }
-    RavMap *map = As_Map(argument1);
 
-    Value argument2 = arguments[1];
-    if (Is_String(argument2) == false) {
-        runtime_error(vm, "`remove` expected string as second argument, got %s", type_repr(argument2));
+    if (Is_Map(cursor->collection) && As_Map(cursor->collection)->dict.resizes != cursor->resizes) {
+        runtime_error(vm, "`%s` map resized during iteration", cursor->native);
+        return false;
+    }
+
+    return true;
+}
+
+// Collect the values into a new collection of the same type as the
+// iterated one, the result is kept on the stack, while allocating. Lists
+// are collected into an array first, to be built at once.
+typedef struct {
+    Value result;
+    Value *slot; // Stack slot of the result
+    bool list;
+} Collector;
+
+static void collector_init(VM *vm, Collector *collector, Value collection, size_t capacity) {
+    collector->list = !Is_Array(collection) && !Is_Map(collection);
+
+    if (Is_Map(collection)) {
+        collector->result = Obj_Value(object_map(&vm->allocator));
+    } else {
+        collector->result = Obj_Value(object_array_empty(&vm->allocator, capacity));
+    }
+
+    collector->slot = vm->stack_top;
+    push(vm, collector->result);
+}
+
+// Add the value, keyed for maps, both must be kept on the stack.
+static void collector_add(VM *vm, Collector *collector, Value key, Value value) {
+    Value result = collector->result;
+
+    if (Is_Array(result)) {
+        object_array_push(&vm->allocator, As_Array(result), value);
+    } else {
+        dict_set(&As_Map(result)->dict, key, value);
+    }
+}
+
+static Value collector_finish(VM *vm, Collector *collector) {
+    if (collector->list) {
+        RavArray *array = As_Array(collector->result);
+        if (array->packed) {
+            object_array_unpack(&vm->allocator, array);
+        }
+
+        // the array holds the heads followed by the tail
+        size_t count = array->count;
+        object_array_push(&vm->allocator, array, Nil_Value);
+        object_list(&vm->allocator, array->values, count);
+        collector->result = array->values[count];
+    }
+
+    pop(vm);
+    return collector->result;
+}
+
+static bool native_each(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Cursor cursor;
+    Value function = arguments[1];
+    if (!collection_argument(vm, "each", arguments[0], &cursor) ||
+        !function_argument(vm, "each", "second", function)) {
+        return false;
+    }
+
+    Value key = Nil_Value, element, returned;
+    while (cursor_next(&cursor, &key, &element)) {
+        if (!call_element(vm, function, &cursor, NULL, key, element, &returned)) {
+            return false;
+        }
+    }
+
+    *result = arguments[0];
+    return true;
+}
+
+static bool native_map(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Cursor cursor;
+    Value function = arguments[1];
+    if (!collection_argument(vm, "map", arguments[0], &cursor) ||
+        !function_argument(vm, "map", "second", function)) {
+        return false;
+    }
+
+    // arrays are mapped to arrays of the same length
+    size_t capacity = Is_Array(arguments[0]) ? As_Array(arguments[0])->count : 0;
+
+    Collector collector;
+    collector_init(vm, &collector, arguments[0], capacity);
+
+    Value key = Nil_Value, element, returned;
+    while (cursor_next(&cursor, &key, &element)) {
+        if (!call_element(vm, function, &cursor, NULL, key, element, &returned)) {
+            return false;
+        }
+
+        push(vm, key);
+        push(vm, returned);
+        collector_add(vm, &collector, key, returned);
+        vm->stack_top -= 2;
+    }
+
+    *result = collector_finish(vm, &collector);
+    return true;
+}
+
+static bool native_filter(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Cursor cursor;
+    Value function = arguments[1];
+    if (!collection_argument(vm, "filter", arguments[0], &cursor) ||
+        !function_argument(vm, "filter", "second", function)) {
+        return false;
+    }
+
+    Collector collector;
+    collector_init(vm, &collector, arguments[0], 0);
+
+    Value key = Nil_Value, element, returned;
+    while (cursor_next(&cursor, &key, &element)) {
+        // the function may remove the element from the collection
+        push(vm, key);
+        push(vm, element);
+
+        if (!call_element(vm, function, &cursor, NULL, key, element, &returned)) {
+            return false;
+        }
+        if (!is_falsy(returned)) {
+            collector_add(vm, &collector, key, element);
+        }
+
+        vm->stack_top -= 2;
+    }
+
+    *result = collector_finish(vm, &collector);
+    return true;
+}
+
+static bool native_reduce(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Cursor cursor;
+    Value function = arguments[1];
+    if (!collection_argument(vm, "reduce", arguments[0], &cursor) ||
+        !function_argument(vm, "reduce", "second", function)) {
+        return false;
+    }
+
+    // the accumulator is always an argument of the next call, or the
+    // result, so it's reachable without being kept on the stack
+    Value accumulator = arguments[2];
+    Value key = Nil_Value, element;
+    while (cursor_next(&cursor, &key, &element)) {
+        if (!call_element(vm, function, &cursor, &accumulator, key, element, &accumulator)) {
+            return false;
+        }
+    }
+
+    *result = accumulator;
+    return true;
+}
+
+static bool native_find(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Cursor cursor;
+    Value function = arguments[1];
+    if (!collection_argument(vm, "find", arguments[0], &cursor) ||
+        !function_argument(vm, "find", "second", function)) {
+        return false;
+    }
+
+    // the first element, or the key of maps entries, the function holds for
+    Value key = Nil_Value, element, returned;
+    while (cursor_next(&cursor, &key, &element)) {
+        if (!call_element(vm, function, &cursor, NULL, key, element, &returned)) {
+            return false;
+        }
+        if (!is_falsy(returned)) {
+            *result = Is_Map(cursor.collection) ? key : element;
+            return true;
+        }
+    }
+
+    *result = Nil_Value;
+    return true;
+}
+
+// File Native Functions
+
+#define FILE_BUFFER_SIZE 65536
+
+static bool native_open(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    Value argument = arguments[0];
+    RavString *path_string = text_argument(vm, argument);
+    if (path_string == NULL) {
+        runtime_error(vm, "`open` expected string, got %s", type_repr(argument));
+        return false;
+    }
+
+    const char *path = path_string->chars;
+
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) != 0) {
+        runtime_error(vm, "`open` error opening '%s' (%s)", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return false;
+    }
+
+    RavFile *file = object_file(&vm->allocator, path_string);
+    file->closed = false;
+    file->fd = fd;
+
+    // Regular files are mapped, and read in place.
+    if (S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data != MAP_FAILED) {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            close(fd);
+
+            file->fd = -1;
+            file->mapped = true;
+            file->data = data;
+            file->size = info.st_size;
+        }
+    }
+
+    *result = Obj_Value(file);
+    return true;
+}
+
+// Check that the argument is an opened file.
+static RavFile *file_argument(VM *vm, const char *native, Value argument) {
+    if (Is_File(argument) == false) {
+        runtime_error(vm, "`%s` expected file as first argument, got %s", native, type_repr(argument));
+        return NULL;
+    }
+
+    RavFile *file = As_File(argument);
+    if (file->closed) {
+        runtime_error(vm, "`%s` on a closed file '%s'", native, file->path->chars);
+        return NULL;
+    }
+
+    return file;
+}
+
+// Read more bytes into the buffer of a non-mapped file, moving the unread
+// bytes to the beginning of the buffer first. Return false on errors. The
+// pending output is flushed first, since the read may block (e.g. on a
+// prompt read from stdin).
+static bool file_fill(VM *vm, RavFile *file) {
+    vm_flush(vm);
+
+    if (file->offset > 0) {
+        memmove(file->data, file->data + file->offset, file->size - file->offset);
+        file->size -= file->offset;
+        file->offset = 0;
+    }
+
+    if (file->size == file->capacity) {
+        file->capacity = file->capacity ? file->capacity * 2 : FILE_BUFFER_SIZE;
+        file->data = realloc(file->data, file->capacity);
+    }
+
+    for (;;) {
+        ssize_t bytes_read = read(file->fd, file->data + file->size, file->capacity - file->size);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read < 0) {
+            return false;
+        }
+
+        file->eof = bytes_read == 0;
+        file->size += bytes_read;
+        return true;
+    }
+}
+
+// Return the read characters of a file, as a slice of a mapped file, or
+// as a string copied from the buffer of other files, which is reused.
+static Value file_text(VM *vm, RavFile *file, const char *chars, size_t length) {
+    // longer lines are split at the strings length limit
+    if (length > INT32_MAX) {
+        length = INT32_MAX;
+        file->offset = chars + length - file->data;
+    }
+
+    if (file->mapped) {
+        return Obj_Value(object_slice(&vm->allocator, (Object *)file, chars, length));
+    }
+    return Obj_Value(object_string(&vm->allocator, chars, length));
+}
+
+static bool native_read_line(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavFile *file = file_argument(vm, "read_line", arguments[0]);
+    if (file == NULL) {
+        return false;
+    }
+
+    // scanned bytes count after the offset, which is reset by file_fill
+    size_t scanned = 0;
+    char *end = NULL;
+
+    for (;;) {
+        size_t unscanned = file->size - file->offset - scanned;
+        end = unscanned ? memchr(file->data + file->offset + scanned, '\n', unscanned) : NULL;
+
+        if (end != NULL || file->mapped || file->eof) {
+            break;
+        }
+
+        scanned = file->size - file->offset;
+        if (!file_fill(vm, file)) {
+            runtime_error(vm, "`read_line` error reading '%s' (%s)", file->path->chars, strerror(errno));
+            return false;
+        }
+    }
+
+    if (end == NULL && file->offset == file->size) {
+        *result = Nil_Value;
+        return true;
+    }
+
+    // the last line may not end with a new line
+    const char *line = file->data + file->offset;
+    size_t length = end ? (size_t)(end - line) : file->size - file->offset;
+    file->offset += length + (end != NULL);
+
+    *result = file_text(vm, file, line, length);
+    return true;
+}
+
+static bool native_read_chunk(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavFile *file = file_argument(vm, "read_chunk", arguments[0]);
+    if (file == NULL) {
+        return false;
+    }
+
+    Value argument = arguments[1];
+    if (!Is_Num(argument) || As_Num(argument) < 1 || As_Num(argument) > INT32_MAX) {
+        runtime_error(vm, "`read_chunk` expected positive size as second argument, got %s", type_repr(argument));
+        return false;
+    }
+    size_t size = (size_t)As_Num(argument);
+
+    while (!file->mapped && !file->eof && file->size - file->offset < size) {
+        if (!file_fill(vm, file)) {
+            runtime_error(vm, "`read_chunk` error reading '%s' (%s)", file->path->chars, strerror(errno));
+            return false;
+        }
+    }
+
+    if (file->offset == file->size) {
+        *result = Nil_Value;
+        return true;
+    }
+
+    const char *chunk = file->data + file->offset;
+    size_t length = size < file->size - file->offset ? size : file->size - file->offset;
+    file->offset += length;
+
+    *result = file_text(vm, file, chunk, length);
+    return true;
+}
+
+static bool native_close(VM *vm, Value *arguments, size_t count, Value *result) {
+    MAYBE_UNUSED(count);
+
+    RavFile *file = file_argument(vm, "close", arguments[0]);
+    if (file == NULL) {
         return false;
     }
-    RavString *key = As_String(argument2);
 
-    *result = table_remove(&map->table, key);
+    object_file_close(file);
+    *result = Nil_Value;
     return true;
 }
 
+#undef FILE_BUFFER_SIZE
+
 static void register_natives(VM* vm) {
     vm->allocator.gc_off = true;
 
@@ -1043,18 +2318,39 @@ static void register_natives(VM* vm) {
     do {                                                                                            \
         RavCFunction *func = object_cfunction(&vm->allocator, native_##name, arity_min, arity_max); \
         RavString *name_string = object_string(&vm->allocator, #name, strlen(#name));               \
-        table_set(&vm->globals, name_string, Obj_Value(func));                                      \
+        table_set(&vm->globals, Obj_Value(name_string), Obj_Value(func));                           \
     } while (false)
 
     Register(import,  1, 1);
+    Register(reload,  1, 1);
     Register(assert,  1, 2);
     Register(print,   0, PARAMS_LIMIT); // variadic
     Register(println, 0, PARAMS_LIMIT); // variadic
     Register(len,     1, 1);
     Register(push,    2, PARAMS_LIMIT); // variadic
     Register(pop,     1, 1);
+    Register(copy,    1, 1);
+    Register(fill,    2, 2);
+    Register(sort,    1, 2);
+    Register(sum,     1, 1);
+    Register(min,     1, 1);
+    Register(max,     1, 1);
+    Register(dot,     2, 2);
+    Register(scale,   2, 2);
+    Register(hcons,   2, 2);
     Register(insert,  3, 3);
     Register(remove,  2, 2);
+    Register(each,    2, 2);
+    Register(map,     2, 2);
+    Register(filter,  2, 2);
+    Register(reduce,  3, 3);
+    Register(find,    2, 2);
+    Register(slice,      2, 3);
+    Register(split,      2, 2);
+    Register(open,       1, 1);
+    Register(read_line,  1, 1);
+    Register(read_chunk, 2, 2);
+    Register(close,      1, 1);
 
 #undef Register
 }
@@ -1064,29 +2360,57 @@ static void register_natives(VM* vm) {
 void init_vm(VM *vm) {
     vm->open_upvalues = NULL;
     vm->reset_on_exit = true;
+    vm->frame_base = 0;
+
+    vm->output = string_buf_new(NULL);
+    vm->output_line = isatty(STDOUT_FILENO);
 
     allocator_init(&vm->allocator);
     table_init(&vm->globals);
+    table_init(&vm->modules);
     reset_stack(vm);
     register_natives(vm);
 }
 
 void free_vm(VM *vm) {
+    vm_flush(vm);
+    string_buf_free(&vm->output);
+
     table_free(&vm->globals);
+    table_free(&vm->modules);
     allocator_free(&vm->allocator);
     *vm = (VM){0};
 }
 
-InterpretResult interpret(VM *vm, const char *source, const char *path) {
-    // Disable the GC while compiling.
-    vm->allocator.gc_off = true;
-    vm->x = Nil_Value;
+void vm_print(VM *vm, Value value) {
+    string_buf_push(&vm->output, value);
+    string_buf_write(&vm->output, "\n", 1);
+    output_written(vm, true);
+}
 
-    RavFunction *function = compile(vm, source, path);
-    if (function == NULL) {
-        return INTERPRET_COMPILE_ERROR;
+void vm_flush(VM *vm) {
+    // anything written through stdio goes first
+    fflush(stdout);
+
+    const char *buffer = vm->output.buffer;
+    int remaining = vm->output.count;
+
+    while (remaining > 0) {
+        ssize_t written = write(STDOUT_FILENO, buffer, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break; // the output is lost, as with stdio
+        }
+
+        buffer += written;
+        remaining -= written;
     }
 
+    vm->output.count = 0;
+}
+
+// Execute a compiled top-level function, the GC must be disabled.
+static InterpretResult execute(VM *vm, RavFunction *function, const char *path) {
     RavClosure *closure = object_closure(&vm->allocator, function);
     push(vm, Obj_Value(closure));
 
@@ -1098,3 +2422,65 @@ InterpretResult interpret(VM *vm, const char *source, const char *path) {
     vm->allocator.gc_off = false;
     return run_vm(vm);
 }
+
+InterpretResult interpret(VM *vm, const char *source, const char *path) {
+    // Disable the GC while compiling.
+    vm->allocator.gc_off = true;
+    vm->x = Nil_Value;
+
+    RavFunction *function = compile(vm, source, path);
+    if (function == NULL) {
+        return INTERPRET_COMPILE_ERROR;
+    }
+
+    return execute(vm, function, path);
+}
+
+InterpretResult interpret_file(VM *vm, const char *path) {
+    // Disable the GC while compiling.
+    vm->allocator.gc_off = true;
+    vm->x = Nil_Value;
+
+    const char *error = NULL;
+    RavFunction *function = load_file(vm, path, &error);
+    if (function == NULL) {
+        if (error != NULL) {
+            fprintf(stderr, "Fatal: error reading '%s' (%s)\n", path, error);
+        }
+        return INTERPRET_COMPILE_ERROR;
+    }
+
+    return execute(vm, function, path);
+}
+
+bool vm_call(VM *vm, Value callee, int count, Value *arguments, Value *result) {
+    if (vm->stack_top - vm->stack + count + 1 > STACK_SIZE) {
+        runtime_error(vm, "stack overflows");
+        return false;
+    }
+
+    push(vm, callee);
+    for (int i = 0; i < count; i++) {
+        push(vm, arguments[i]);
+    }
+
+    int frame_count = vm->frame_count;
+    if (!call_value(vm, callee, count)) {
+        return false;
+    }
+
+    // closures push a frame, which runs until it returns
+    if (vm->frame_count > frame_count) {
+        int frame_base = vm->frame_base;
+        vm->frame_base = frame_count;
+        InterpretResult interpreted = run_vm(vm);
+        vm->frame_base = frame_base;
+
+        if (interpreted != INTERPRET_OK) {
+            return false;
+        }
+    }
+
+    *result = pop(vm);
+    return true;
+}
@@ -28,10 +28,22 @@ typedef struct {
     CallFrame frames[FRAMES_LIMIT];
     int frame_count;
 
+    // Frames count at which returning stops the execution, set while a
+    // native function calls back into the vm.
+    int frame_base;
+
     Table globals;
 
+    // Cache of the imported modules exports, keyed by canonical path.
+    Table modules;
+
     // Intrusive linked list of all available open opvalues.
     RavUpvalue *open_upvalues;
+
+    // Buffered standard output, flushed when it's full, on exit, and
+    // on every new line if `output_line` is set (interactive output).
+    StringBuffer output;
+    bool output_line;
 } VM;
 
 typedef enum {
@@ -46,8 +58,27 @@ void init_vm(VM *vm);
 // Free the resources owned by the vm.
 void free_vm(VM *vm);
 
+// Print the value followed by a new line to the buffered output.
+void vm_print(VM *vm, Value value);
+
+// Write the buffered output to the standard output.
+void vm_flush(VM *vm);
+
+// Call the callee, a closure or a native function, with the arguments and
+// set `result` to the returned value. Closures run in a nested dispatch
+// loop on the current stack, until their frame returns. Return false on
+// runtime errors, which are reported before the stack is reset, so
+// natives calling back into the vm must return false in turn.
+bool vm_call(VM *vm, Value callee, int count, Value *arguments, Value *result);
+
 // Execute the given source code, and return
 // the interpretation result.
 InterpretResult interpret(VM *vm, const char *source, const char *path);
 
+// Execute the source file at the given path, and return the
+// interpretation result. The compiled bytecode is cached in a
+// '.ravc' file next to the source, and reused while the source
+// file is unchanged.
+InterpretResult interpret_file(VM *vm, const char *path);
+
 #endif